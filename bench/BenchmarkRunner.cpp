@@ -0,0 +1,94 @@
+#include "BenchmarkRunner.h"
+
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QSysInfo>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+
+using Clock = std::chrono::steady_clock;
+
+BenchmarkRunner::BenchmarkRunner(double minSeconds, const QString& filter)
+    : m_MinSeconds{ minSeconds }, m_Filter{ filter }
+{}
+
+void BenchmarkRunner::run(const QString& name, const std::function<void()>& workload)
+{
+    if (!m_Filter.isEmpty() && !name.contains(m_Filter)) {
+        return;
+    }
+
+    // The first call warms caches and gives an estimate for the batch size
+    auto start = Clock::now();
+    workload();
+    double estimate = std::chrono::duration<double>(Clock::now() - start).count();
+
+    qint64 batch = 1;
+    if (estimate < MinBatchSeconds) {
+        batch = static_cast<qint64>(MinBatchSeconds / qMax(estimate, 1e-9)) + 1;
+    }
+
+    std::vector<double> samples;
+    double total = 0.0;
+    qint64 iterations = 0;
+
+    while (total < m_MinSeconds || samples.size() < MinSamples) {
+        start = Clock::now();
+        for (qint64 i = 0; i < batch; i++) {
+            workload();
+        }
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+        samples.push_back(elapsed * 1e9 / batch);
+        total += elapsed;
+        iterations += batch;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.meanNs = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    result.medianNs = samples[samples.size() / 2];
+    result.minNs = samples.front();
+    result.maxNs = samples.back();
+
+    std::fprintf(
+        stderr,
+        "%-40s %14.0f ns  (%lld iterations)\n",
+        qUtf8Printable(name),
+        result.medianNs,
+        static_cast<long long>(iterations));
+
+    m_Results.push_back(result);
+}
+
+QJsonDocument BenchmarkRunner::toJson() const
+{
+    QJsonArray benchmarks;
+    for (auto& result : m_Results) {
+        benchmarks.append(QJsonObject{
+            { "name", result.name },
+            { "iterations", result.iterations },
+            { "mean_ns", result.meanNs },
+            { "median_ns", result.medianNs },
+            { "min_ns", result.minNs },
+            { "max_ns", result.maxNs },
+        });
+    }
+
+    return QJsonDocument(QJsonObject{
+        { "version", 1 },
+        { "date", QDateTime::currentDateTimeUtc().toString(Qt::ISODate) },
+        { "host", QSysInfo::machineHostName() },
+        { "cpu_architecture", QSysInfo::currentCpuArchitecture() },
+        { "os", QSysInfo::prettyProductName() },
+        { "qt_version", qVersion() },
+        { "benchmarks", benchmarks },
+    });
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QJsonDocument>
+#include <QString>
+
+#include <functional>
+#include <vector>
+
+// Times small CPU workloads in batches until a minimum run time is reached
+class BenchmarkRunner
+{
+public:
+    struct Result
+    {
+        QString name;
+        qint64 iterations = 0;
+        double meanNs = 0.0;
+        double medianNs = 0.0;
+        double minNs = 0.0;
+        double maxNs = 0.0;
+    };
+
+    BenchmarkRunner(double minSeconds, const QString& filter);
+
+    BenchmarkRunner(const BenchmarkRunner&) = delete;
+    BenchmarkRunner(BenchmarkRunner&&) = delete;
+    BenchmarkRunner& operator=(const BenchmarkRunner&) = delete;
+    BenchmarkRunner& operator=(BenchmarkRunner&&) = delete;
+
+    // Skipped unless the name contains the filter
+    void run(const QString& name, const std::function<void()>& workload);
+
+    const std::vector<Result>& results() const { return m_Results; }
+    QJsonDocument toJson() const;
+
+private:
+    inline static constexpr double MinBatchSeconds = 0.001;
+    inline static constexpr int MinSamples = 5;
+
+    double m_MinSeconds;
+    QString m_Filter;
+    std::vector<Result> m_Results;
+};
+
+// Keeps the compiler from discarding a computed value
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+    // Reading through a volatile pointer forces the value to be materialized
+    static volatile char sink;
+    sink = *reinterpret_cast<const volatile char*>(&value);
+}
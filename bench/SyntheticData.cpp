@@ -0,0 +1,123 @@
+#include "SyntheticData.h"
+
+#include <libbsarch.h>
+
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+
+static const wchar_t* toWide(const QString& string)
+{
+    static_assert(sizeof(wchar_t) == 2, "Expected wchar_t to be 2 bytes");
+    return reinterpret_cast<const wchar_t*>(string.utf16());
+}
+
+bool writeSyntheticNif(
+    const QString& path,
+    const nifly::NiVersion& version,
+    int shapes,
+    int vertices,
+    int depth,
+    bool normals)
+{
+    // Triangle indices are 16 bit
+    int side = qBound(2, static_cast<int>(std::sqrt(vertices)), 255);
+
+    std::vector<nifly::Vector3> verts;
+    std::vector<nifly::Vector3> norms;
+    std::vector<nifly::Vector2> uvs;
+    std::vector<nifly::Triangle> tris;
+
+    for (int y = 0; y < side; y++) {
+        for (int x = 0; x < side; x++) {
+            float height = std::sin(x * 0.3f) * std::cos(y * 0.2f) * 4.0f;
+            verts.emplace_back(static_cast<float>(x), static_cast<float>(y), height);
+            norms.emplace_back(0.0f, 0.0f, 1.0f);
+            uvs.emplace_back(x / (side - 1.0f), y / (side - 1.0f));
+        }
+    }
+
+    for (int y = 0; y < side - 1; y++) {
+        for (int x = 0; x < side - 1; x++) {
+            auto i = static_cast<std::uint16_t>(y * side + x);
+            auto s = static_cast<std::uint16_t>(side);
+            tris.emplace_back(i, i + 1, i + s);
+            tris.emplace_back(i + 1, i + s + 1, i + s);
+        }
+    }
+
+    nifly::NifFile nifFile;
+    nifFile.Create(version);
+
+    auto parent = nifFile.GetRootNode();
+    for (int i = 0; i < depth; i++) {
+        nifly::MatTransform xform;
+        xform.translation = nifly::Vector3(1.0f, 2.0f, 3.0f);
+        xform.scale = 1.01f;
+        parent = nifFile.AddNode("Node" + std::to_string(i), xform, parent);
+    }
+
+    for (int i = 0; i < shapes; i++) {
+        auto shape = nifFile.CreateShapeFromData(
+            "Shape" + std::to_string(i), &verts, &tris, &uvs, normals ? &norms : nullptr);
+        if (shape && parent) {
+            nifFile.SetParentNode(shape, parent);
+        }
+    }
+
+    return nifFile.Save(std::filesystem::path(path.toStdWString())) == 0;
+}
+
+QByteArray makeSyntheticDds(gli::format format, int size)
+{
+    gli::texture2d texture{ format, gli::extent2d(size, size) };
+
+    // Noise keeps block compressed data from being trivially uniform
+    auto data = static_cast<std::uint8_t*>(texture.data());
+    std::uint32_t state = 0x12345678;
+    for (std::size_t i = 0; i < texture.size(); i++) {
+        state = state * 1664525u + 1013904223u;
+        data[i] = static_cast<std::uint8_t>(state >> 24);
+    }
+
+    std::vector<char> memory;
+    if (!gli::save_dds(texture, memory)) {
+        return {};
+    }
+
+    return QByteArray(memory.data(), static_cast<qsizetype>(memory.size()));
+}
+
+bool writeSyntheticArchive(
+    const QString& path,
+    const std::vector<std::pair<QString, QByteArray>>& files)
+{
+    auto entries = bsa_entry_list_create();
+    for (auto& [name, data] : files) {
+        bsa_entry_list_add(entries, toWide(name));
+    }
+
+    auto bsa = bsa_create();
+    auto result = bsa_create_archive(bsa, toWide(path), baSSE, entries);
+
+    for (auto& [name, data] : files) {
+        if (result.code == BSA_RESULT_EXCEPTION) {
+            break;
+        }
+
+        result = bsa_add_file_from_memory(
+            bsa,
+            toWide(name),
+            static_cast<std::uint32_t>(data.size()),
+            const_cast<char*>(data.constData()));
+    }
+
+    if (result.code != BSA_RESULT_EXCEPTION) {
+        result = bsa_save(bsa);
+    }
+
+    bsa_free(bsa);
+    bsa_entry_list_free(entries);
+
+    return result.code != BSA_RESULT_EXCEPTION;
+}
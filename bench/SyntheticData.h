@@ -0,0 +1,28 @@
+#pragma once
+
+#include <NifFile.hpp>
+#include <gli/gli.hpp>
+
+#include <QByteArray>
+#include <QString>
+
+#include <utility>
+#include <vector>
+
+// Writes a NIF with grid meshes of roughly the given vertex count, parented below a
+// chain of nodes so global transforms have some depth to walk
+bool writeSyntheticNif(
+    const QString& path,
+    const nifly::NiVersion& version,
+    int shapes,
+    int vertices,
+    int depth,
+    bool normals);
+
+// Returns a DDS file with a full mip chain of noise
+QByteArray makeSyntheticDds(gli::format format, int size);
+
+// Writes an SSE archive containing the given data relative files
+bool writeSyntheticArchive(
+    const QString& path,
+    const std::vector<std::pair<QString, QByteArray>>& files);
@@ -0,0 +1,362 @@
+#include "BenchmarkRunner.h"
+#include "SyntheticData.h"
+
+#include "ArchiveIndex.h"
+#include "DdsLoader.h"
+#include "MeshSimplifier.h"
+#include "NifExtensions.h"
+#include "PathResolver.h"
+#include "SceneGraph.h"
+#include "TangentFrame.h"
+
+#include <NifFile.hpp>
+#include <gli/gli.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+struct Workspace
+{
+    QTemporaryDir directory;
+
+    QString smallNif;
+    QString largeNif;
+    QString legacyNif;
+    QString deepNif;
+
+    QByteArray compressedDds;
+    QByteArray uncompressedDds;
+
+    QStringList archives;
+    QStringList archivedTextures;
+    QStringList looseTextures;
+};
+
+static bool writeFile(const QString& path, const QByteArray& data)
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QFile file{ path };
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+static bool createWorkspace(Workspace& workspace)
+{
+    if (!workspace.directory.isValid()) {
+        return false;
+    }
+
+    auto data = QDir(workspace.directory.path());
+    auto sse = nifly::NiVersion::getSSE();
+    auto legacy = nifly::NiVersion::getSK();
+
+    workspace.smallNif = data.filePath("meshes/small.nif");
+    workspace.largeNif = data.filePath("meshes/large.nif");
+    workspace.legacyNif = data.filePath("meshes/legacy.nif");
+    workspace.deepNif = data.filePath("meshes/deep.nif");
+    data.mkpath("meshes");
+
+    bool ok = writeSyntheticNif(workspace.smallNif, sse, 4, 1024, 2, true) &&
+              writeSyntheticNif(workspace.largeNif, sse, 32, 16384, 4, true) &&
+              writeSyntheticNif(workspace.legacyNif, legacy, 8, 16384, 4, false) &&
+              writeSyntheticNif(workspace.deepNif, sse, 64, 64, 32, true);
+
+    workspace.compressedDds = makeSyntheticDds(gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16, 1024);
+    workspace.uncompressedDds = makeSyntheticDds(gli::FORMAT_RGBA8_UNORM_PACK8, 1024);
+    auto smallDds = makeSyntheticDds(gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8, 64);
+
+    // A few hundred loose files and an archive with a couple thousand entries
+    for (int i = 0; i < 256; i++) {
+        auto path = QString("textures/loose/%1.dds").arg(i, 4, 10, QChar('0'));
+        workspace.looseTextures.append(path);
+        ok = ok && writeFile(data.filePath(path), smallDds);
+    }
+
+    std::vector<std::pair<QString, QByteArray>> archived;
+    for (int i = 0; i < 2048; i++) {
+        auto path = QString("textures\\archived\\%1.dds").arg(i, 4, 10, QChar('0'));
+        workspace.archivedTextures.append(path);
+        archived.emplace_back(path, smallDds);
+    }
+
+    auto archive = data.filePath("Synthetic.bsa");
+    ok = ok && writeSyntheticArchive(archive, archived);
+    workspace.archives.append(QDir::toNativeSeparators(archive));
+
+    return ok;
+}
+
+static void benchmarkParse(BenchmarkRunner& runner, const Workspace& workspace)
+{
+    auto parse = [](const QString& fileName) {
+        return [path = std::filesystem::path(fileName.toStdWString())]() {
+            nifly::NifFile nifFile{ path };
+            doNotOptimize(nifFile.IsValid());
+        };
+    };
+
+    runner.run("nif_parse/sse_small", parse(workspace.smallNif));
+    runner.run("nif_parse/sse_large", parse(workspace.largeNif));
+    runner.run("nif_parse/le_large", parse(workspace.legacyNif));
+}
+
+static void benchmarkTransforms(BenchmarkRunner& runner, const Workspace& workspace)
+{
+    nifly::NifFile nifFile{ std::filesystem::path(workspace.deepNif.toStdWString()) };
+    auto shapes = nifFile.GetShapes();
+
+    runner.run("shape_transform_to_global/depth_32", [&]() {
+        for (auto shape : shapes) {
+            auto xform = GetShapeTransformToGlobal(&nifFile, shape);
+            doNotOptimize(xform.translation.x);
+        }
+    });
+
+    runner.run("bounding_sphere/depth_32", [&]() {
+        for (auto shape : shapes) {
+            auto bounds = GetBoundingSphere(&nifFile, shape);
+            doNotOptimize(bounds.radius);
+        }
+    });
+
+    // The renderer builds the graph once and then looks up every shape
+    runner.run("scene_graph/depth_32", [&]() {
+        SceneGraph sceneGraph{ &nifFile };
+        for (auto shape : shapes) {
+            auto xform = sceneGraph.transformToGlobal(shape);
+            auto bounds = sceneGraph.boundingSphere(&nifFile, shape);
+            doNotOptimize(xform.translation.x);
+            doNotOptimize(bounds.radius);
+        }
+    });
+}
+
+static void benchmarkTangentSpace(BenchmarkRunner& runner, const Workspace& workspace)
+{
+    nifly::NifFile nifFile{ std::filesystem::path(workspace.legacyNif.toStdWString()) };
+    auto shapes = nifFile.GetShapes();
+
+    // Same recalculation the preview does for shapes that lack the data
+    for (auto shape : shapes) {
+        shape->SetNormals(true);
+        shape->SetTangents(true);
+    }
+
+    runner.run("recalc_normals/le_16k", [&]() {
+        for (auto shape : shapes) {
+            if (auto geomData = shape->GetGeomData()) {
+                geomData->RecalcNormals();
+            }
+        }
+    });
+
+    runner.run("calc_tangents/le_16k", [&]() {
+        for (auto shape : shapes) {
+            if (auto geomData = shape->GetGeomData()) {
+                geomData->CalcTangentSpace();
+            }
+        }
+    });
+
+    // The preview's replacement, working on the staged vertices instead
+    auto layout = VertexLayout::create(true);
+    std::vector<std::vector<char>> vertices;
+    std::vector<std::vector<nifly::Triangle>> triangles;
+
+    for (auto shape : shapes) {
+        auto verts = nifFile.GetVertsForShape(shape);
+        auto uvs = nifFile.GetUvsForShape(shape);
+        std::size_t count = verts ? qMin<std::size_t>(verts->size(), shape->GetNumVertices()) : 0;
+        auto& staged = vertices.emplace_back(shape->GetNumVertices() * layout.stride);
+
+        for (std::size_t i = 0; i < count; i++) {
+            auto out = staged.data() + i * layout.stride;
+            std::memcpy(out + layout.position, &(*verts)[i], 3 * sizeof(float));
+
+            if (uvs && i < uvs->size()) {
+                std::uint16_t uv[2] = {
+                    glm::packHalf1x16((*uvs)[i].u),
+                    glm::packHalf1x16((*uvs)[i].v),
+                };
+                std::memcpy(out + layout.texCoord, uv, sizeof(uv));
+            }
+        }
+
+        shape->GetTriangles(triangles.emplace_back());
+    }
+
+    runner.run("tangent_frame/le_16k", [&]() {
+        for (std::size_t i = 0; i < vertices.size(); i++) {
+            generateTangentFrame(
+                layout,
+                vertices[i].data(),
+                vertices[i].size() / layout.stride,
+                reinterpret_cast<const std::uint16_t*>(triangles[i].data()),
+                triangles[i].size() * 3,
+                true,
+                true);
+        }
+        doNotOptimize(vertices.front().front());
+    });
+}
+
+static void benchmarkSimplify(BenchmarkRunner& runner, const Workspace& workspace)
+{
+    nifly::NifFile nifFile{ std::filesystem::path(workspace.largeNif.toStdWString()) };
+    auto shape = nifFile.GetShapes().front();
+
+    std::vector<float> positions;
+    if (auto verts = nifFile.GetVertsForShape(shape)) {
+        for (auto& vert : *verts) {
+            positions.insert(positions.end(), { vert.x, vert.y, vert.z });
+        }
+    }
+
+    std::vector<nifly::Triangle> triangles;
+    shape->GetTriangles(triangles);
+    auto indices = reinterpret_cast<const std::uint16_t*>(triangles.data());
+
+    // Reduced detail drawn while orbiting, at a tenth of the triangles
+    runner.run("mesh_simplify/sse_16k", [&]() {
+        auto simplified = MeshSimplifier::simplify(
+            indices,
+            triangles.size() * 3,
+            positions.data(),
+            positions.size() / 3,
+            triangles.size() * 3 / 10);
+        doNotOptimize(simplified.size());
+    });
+}
+
+static void benchmarkResolve(BenchmarkRunner& runner, const Workspace& workspace)
+{
+    DirectoryResolver resolver{ workspace.directory.path(), workspace.archives };
+
+    int next = 0;
+    runner.run("resolve_path/loose_hit", [&]() {
+        auto& path = workspace.looseTextures[next++ % workspace.looseTextures.size()];
+        doNotOptimize(resolver.resolvePath(path).size());
+    });
+
+    runner.run("resolve_path/archived_miss", [&]() {
+        auto& path = workspace.archivedTextures[next++ % workspace.archivedTextures.size()];
+        doNotOptimize(resolver.resolvePath(path).size());
+    });
+}
+
+static void benchmarkArchives(BenchmarkRunner& runner, const Workspace& workspace)
+{
+    auto& index = ArchiveIndex::instance();
+
+    int next = 0;
+    runner.run("archive_lookup/hash_path", [&]() {
+        auto& path = workspace.archivedTextures[next++ % workspace.archivedTextures.size()];
+        doNotOptimize(ArchiveIndex::hashPath(path));
+    });
+
+    runner.run("archive_lookup/extract", [&]() {
+        auto& path = workspace.archivedTextures[next++ % workspace.archivedTextures.size()];
+        doNotOptimize(index.extract(workspace.archives, path).size());
+    });
+
+    runner.run("archive_lookup/miss", [&]() {
+        auto& path = workspace.looseTextures[next++ % workspace.looseTextures.size()];
+        doNotOptimize(index.extract(workspace.archives, path).size());
+    });
+}
+
+static void benchmarkDecode(BenchmarkRunner& runner, const Workspace& workspace)
+{
+    auto decode = [](const QByteArray& data) {
+        return [&data]() {
+            auto texture = gli::load(data.constData(), data.size());
+            doNotOptimize(texture.empty());
+        };
+    };
+
+    runner.run("dds_decode/dxt5_1024", decode(workspace.compressedDds));
+    runner.run("dds_decode/rgba8_1024", decode(workspace.uncompressedDds));
+
+    // Mip selection for a preview that only needs 256 pixels
+    auto decodeLimited = [](const QByteArray& data) {
+        return [&data]() {
+            auto texture = DdsLoader::load(data, 256);
+            doNotOptimize(texture.baseLevel());
+        };
+    };
+
+    runner.run("dds_decode/dxt5_1024_to_256", decodeLimited(workspace.compressedDds));
+    runner.run("dds_decode/rgba8_1024_to_256", decodeLimited(workspace.uncompressedDds));
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app{ argc, argv };
+    QCoreApplication::setApplicationName("preview_nif_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Times the CPU side of loading a NIF preview on synthetic data.");
+    parser.addHelpOption();
+
+    QCommandLineOption outputOption{
+        { "o", "output" },
+        "Writes the JSON results to a file instead of stdout",
+        "file",
+    };
+    QCommandLineOption minTimeOption{
+        "min-time",
+        "Minimum seconds spent on each benchmark",
+        "seconds",
+        "0.5",
+    };
+    QCommandLineOption filterOption{
+        "filter",
+        "Only runs benchmarks whose name contains the text",
+        "text",
+    };
+
+    parser.addOptions({ outputOption, minTimeOption, filterOption });
+    parser.process(app);
+
+    Workspace workspace;
+    if (!createWorkspace(workspace)) {
+        std::fprintf(stderr, "Failed to generate synthetic data\n");
+        return 1;
+    }
+
+    BenchmarkRunner runner{
+        parser.value(minTimeOption).toDouble(),
+        parser.value(filterOption),
+    };
+
+    benchmarkParse(runner, workspace);
+    benchmarkTransforms(runner, workspace);
+    benchmarkTangentSpace(runner, workspace);
+    benchmarkSimplify(runner, workspace);
+    benchmarkResolve(runner, workspace);
+    benchmarkArchives(runner, workspace);
+    benchmarkDecode(runner, workspace);
+
+    auto json = runner.toJson().toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outputOption)) {
+        if (!writeFile(parser.value(outputOption), json)) {
+            std::fprintf(stderr, "Failed to write %s\n", qUtf8Printable(parser.value(outputOption)));
+            return 1;
+        }
+    }
+    else {
+        std::fwrite(json.constData(), 1, json.size(), stdout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,263 @@
+#include "ArchiveIndex.h"
+
+#include <libbsarch.h>
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+
+static_assert(sizeof(wchar_t) == 2, "Expected wchar_t to be 2 bytes");
+
+inline static constexpr quint32 CacheMagic = 0x49414E50; // 'PNAI'
+inline static constexpr quint32 CacheVersion = 1;
+
+ArchiveIndex& ArchiveIndex::instance()
+{
+    static ArchiveIndex index;
+    return index;
+}
+
+ArchiveIndex::~ArchiveIndex()
+{
+    if (m_Warmup.valid()) {
+        m_Warmup.wait();
+    }
+}
+
+void ArchiveIndex::setCacheFile(const QString& cacheFile)
+{
+    std::lock_guard lock{ m_Mutex };
+    if (m_CacheFile != cacheFile) {
+        m_CacheFile = cacheFile;
+        m_CacheLoaded = false;
+    }
+}
+
+void ArchiveIndex::warm(const QStringList& archives)
+{
+    if (m_Warmup.valid() &&
+        m_Warmup.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return;
+    }
+
+    m_Warmup = std::async(std::launch::async, [this, archives]() {
+        std::lock_guard lock{ m_Mutex };
+        update(archives, true);
+    });
+}
+
+QByteArray ArchiveIndex::extract(const QStringList& archives, const QString& path)
+{
+    std::lock_guard lock{ m_Mutex };
+    update(archives, false);
+
+    auto entry = m_Entries.find(hashPath(path));
+    if (entry == m_Entries.end()) {
+        return {};
+    }
+
+    auto bsa = openArchive(m_LoadOrder[entry->second.archive]);
+    if (!bsa) {
+        return {};
+    }
+
+    auto path_utf16 = reinterpret_cast<const wchar_t*>(path.utf16());
+    auto result = bsa_extract_file_data_by_filename(bsa, path_utf16);
+    if (result.message.code == BSA_RESULT_EXCEPTION) {
+        return {};
+    }
+
+    QByteArray data{ static_cast<const char*>(result.buffer.data),
+                     static_cast<qsizetype>(result.buffer.size) };
+    bsa_file_data_free(bsa, result.buffer);
+    return data;
+}
+
+std::uint64_t ArchiveIndex::hashPath(const QString& path)
+{
+    // FNV-1a, stable across runs so the index can be persisted
+    std::uint64_t hash = 0xCBF29CE484222325ULL;
+    for (auto c : path) {
+        c = c == u'/' ? u'\\' : c.toLower();
+        hash = (hash ^ c.unicode()) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+void ArchiveIndex::update(const QStringList& archives, bool checkFiles)
+{
+    if (!m_CacheLoaded) {
+        loadCache();
+    }
+
+    if (!checkFiles && archives == m_LoadOrder) {
+        return;
+    }
+
+    bool changed = archives != m_LoadOrder;
+    for (auto& archive : archives) {
+        auto& record = m_Archives[archive];
+
+        QFileInfo info{ archive };
+        auto modified = info.lastModified().toMSecsSinceEpoch();
+        if (record.size == info.size() && record.modified == modified) {
+            continue;
+        }
+
+        m_OpenArchives.remove_if([&](auto& open) { return open.first == archive; });
+
+        record.size = info.size();
+        record.modified = modified;
+        if (!scanArchive(archive, record)) {
+            record.files.clear();
+        }
+
+        m_CacheDirty = true;
+        changed = true;
+    }
+
+    if (!changed) {
+        return;
+    }
+
+    m_LoadOrder = archives;
+    m_Entries.clear();
+    for (int i = 0; i < m_LoadOrder.size(); i++) {
+        auto& files = m_Archives[m_LoadOrder[i]].files;
+        for (std::uint32_t j = 0; j < files.size(); j++) {
+            m_Entries[files[j]] = { i, j };
+        }
+    }
+
+    if (m_CacheDirty) {
+        saveCache();
+    }
+}
+
+bool ArchiveIndex::scanArchive(const QString& path, ArchiveRecord& record)
+{
+    auto bsa = openArchive(path);
+    if (!bsa) {
+        return false;
+    }
+
+    auto count = bsa_file_count_get(bsa);
+    record.files.clear();
+    record.files.reserve(count);
+
+    wchar_t buffer[1024];
+    for (std::uint32_t i = 0; i < count; i++) {
+        auto length = bsa_filename_get(bsa, i, std::size(buffer), buffer);
+        auto name = QString::fromUtf16(reinterpret_cast<const char16_t*>(buffer), length);
+        record.files.push_back(hashPath(name));
+    }
+
+    return true;
+}
+
+void* ArchiveIndex::openArchive(const QString& path)
+{
+    for (auto it = m_OpenArchives.begin(); it != m_OpenArchives.end(); ++it) {
+        if (it->first == path) {
+            m_OpenArchives.splice(m_OpenArchives.begin(), m_OpenArchives, it);
+            return it->second.get();
+        }
+    }
+
+    auto bsa = bsa_ptr(bsa_create(), [](void* bsa) { bsa_free(bsa); });
+
+    auto path_utf16 = reinterpret_cast<const wchar_t*>(path.utf16());
+    auto result = bsa_load_from_file(bsa.get(), path_utf16);
+    if (result.code == BSA_RESULT_EXCEPTION) {
+        return nullptr;
+    }
+
+    if (m_OpenArchives.size() >= MaxOpenArchives) {
+        m_OpenArchives.pop_back();
+    }
+
+    m_OpenArchives.emplace_front(path, std::move(bsa));
+    return m_OpenArchives.front().second.get();
+}
+
+void ArchiveIndex::loadCache()
+{
+    m_CacheLoaded = true;
+    if (m_CacheFile.isEmpty()) {
+        return;
+    }
+
+    QFile file{ m_CacheFile };
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QDataStream stream{ &file };
+    quint32 magic, version, count;
+    stream >> magic >> version >> count;
+    if (magic != CacheMagic || version != CacheVersion) {
+        return;
+    }
+
+    // A damaged file is discarded as a whole, and mustn't size anything beyond what
+    // it actually holds
+    decltype(m_Archives) archives;
+    for (quint32 i = 0; i < count; i++) {
+        QString path;
+        ArchiveRecord record;
+        quint32 files;
+        stream >> path >> record.size >> record.modified >> files;
+
+        auto bytes = static_cast<qint64>(files) * static_cast<qint64>(sizeof(std::uint64_t));
+        if (stream.status() != QDataStream::Ok || bytes > file.bytesAvailable()) {
+            return;
+        }
+
+        record.files.resize(files);
+        auto data = reinterpret_cast<char*>(record.files.data());
+        if (stream.readRawData(data, static_cast<int>(bytes)) != bytes) {
+            return;
+        }
+
+        archives[path] = std::move(record);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        return;
+    }
+
+    for (auto& [path, record] : archives) {
+        if (!m_Archives.contains(path)) {
+            m_Archives[path] = std::move(record);
+        }
+    }
+}
+
+void ArchiveIndex::saveCache()
+{
+    m_CacheDirty = false;
+    if (m_CacheFile.isEmpty()) {
+        return;
+    }
+
+    QDir().mkpath(QFileInfo(m_CacheFile).absolutePath());
+
+    QSaveFile file{ m_CacheFile };
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+
+    QDataStream stream{ &file };
+    stream << CacheMagic << CacheVersion << static_cast<quint32>(m_Archives.size());
+    for (auto& [path, record] : m_Archives) {
+        stream << path << record.size << record.modified
+               << static_cast<quint32>(record.files.size());
+        stream.writeRawData(
+            reinterpret_cast<const char*>(record.files.data()),
+            record.files.size() * sizeof(std::uint64_t));
+    }
+
+    file.commit();
+}
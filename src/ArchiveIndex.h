@@ -0,0 +1,80 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+#include <cstdint>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Maps file paths to the archive that provides them for the current load order,
+// so lookups don't need to parse every archive header
+class ArchiveIndex
+{
+public:
+    static ArchiveIndex& instance();
+
+    ~ArchiveIndex();
+    ArchiveIndex(const ArchiveIndex&) = delete;
+    ArchiveIndex(ArchiveIndex&&) = delete;
+    ArchiveIndex& operator=(const ArchiveIndex&) = delete;
+    ArchiveIndex& operator=(ArchiveIndex&&) = delete;
+
+    // An empty path disables persisting the index
+    void setCacheFile(const QString& cacheFile);
+
+    // Rescans changed archives on a background thread
+    void warm(const QStringList& archives);
+
+    // Returns the file data from the last archive in the load order that contains it
+    QByteArray extract(const QStringList& archives, const QString& path);
+
+    static std::uint64_t hashPath(const QString& path);
+
+private:
+    struct ArchiveRecord
+    {
+        qint64 size = -1;
+        qint64 modified = 0;
+        std::vector<std::uint64_t> files;
+    };
+
+    struct Entry
+    {
+        int archive;
+        std::uint32_t file;
+    };
+
+    using bsa_ptr = std::unique_ptr<void, void (*)(void*)>;
+
+    ArchiveIndex() = default;
+
+    void update(const QStringList& archives, bool checkFiles);
+    bool scanArchive(const QString& path, ArchiveRecord& record);
+    void* openArchive(const QString& path);
+
+    void loadCache();
+    void saveCache();
+
+    inline static constexpr std::size_t MaxOpenArchives = 8;
+
+    std::mutex m_Mutex;
+    std::future<void> m_Warmup;
+
+    QString m_CacheFile;
+    bool m_CacheLoaded = false;
+    bool m_CacheDirty = false;
+
+    std::map<QString, ArchiveRecord> m_Archives;
+
+    QStringList m_LoadOrder;
+    std::unordered_map<std::uint64_t, Entry> m_Entries;
+
+    std::list<std::pair<QString, bsa_ptr>> m_OpenArchives;
+};
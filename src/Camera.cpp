@@ -4,10 +4,17 @@
 
 void Camera::setDistance(float distance)
 {
-    m_Distance = qBound(MinDistance, distance, MaxDistance);
+    m_Distance = qBound(m_MinDistance, distance, m_MaxDistance);
     cameraMoved();
 }
 
+void Camera::setDistanceRange(float minDistance, float maxDistance)
+{
+    m_MinDistance = minDistance;
+    m_MaxDistance = maxDistance;
+    setDistance(m_Distance);
+}
+
 void Camera::setLookAt(QVector3D lookAt)
 {
     m_LookAt = lookAt;
@@ -31,7 +38,7 @@ void Camera::rotate(float yaw, float pitch)
 void Camera::zoomDistance(float distance)
 {
     m_Distance += distance;
-    m_Distance = qBound(MinDistance, m_Distance, MaxDistance);
+    m_Distance = qBound(m_MinDistance, m_Distance, m_MaxDistance);
 
     cameraMoved();
 }
@@ -39,7 +46,7 @@ void Camera::zoomDistance(float distance)
 void Camera::zoomFactor(float factor)
 {
     m_Distance *= factor;
-    m_Distance = qBound(MinDistance, m_Distance, MaxDistance);
+    m_Distance = qBound(m_MinDistance, m_Distance, m_MaxDistance);
 
     cameraMoved();
 }
@@ -14,6 +14,9 @@ public:
     float distance() { return m_Distance; }
 
     void setDistance(float distance);
+
+    // Worldspace views zoom out much further than single NIFs
+    void setDistanceRange(float minDistance, float maxDistance);
     void setLookAt(QVector3D lookAt);
 
     void pan(QVector3D delta);
@@ -22,15 +25,14 @@ public:
     void zoomFactor(float factor);
 
 private:
-    inline static constexpr float MinDistance = 1.0f;
-    inline static constexpr float MaxDistance = 5000.0f;
-
     static float repeat(float value, float min, float max);
 
     QVector3D m_LookAt;
     float m_Pitch = 0.0f;
     float m_Yaw = 0.0f;
     float m_Distance = 100.0f;
+    float m_MinDistance = 1.0f;
+    float m_MaxDistance = 5000.0f;
 
 signals:
     void cameraMoved();
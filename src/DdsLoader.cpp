@@ -0,0 +1,200 @@
+#include "DdsLoader.h"
+
+#include <QFile>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+constexpr std::size_t HeaderSize = 128;
+constexpr std::size_t HeaderDX10Size = 148;
+
+constexpr std::size_t FlagsOffset = 8;
+constexpr std::size_t HeightOffset = 12;
+constexpr std::size_t WidthOffset = 16;
+constexpr std::size_t DepthOffset = 24;
+constexpr std::size_t MipMapCountOffset = 28;
+constexpr std::size_t FormatFlagsOffset = 80;
+constexpr std::size_t FourCCOffset = 84;
+constexpr std::size_t ArraySizeOffset = 140;
+
+// Larger than any texture GL accepts, which also keeps the sizes below from overflowing
+constexpr std::uint32_t MaxExtent = 16384;
+constexpr std::uint32_t MaxLayers = 2048;
+
+constexpr std::uint32_t DDSD_DEPTH = 0x800000;
+constexpr std::uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+constexpr std::uint32_t DDPF_FOURCC = 0x4;
+constexpr std::uint32_t FourCC_DX10 = 0x30315844;
+
+std::uint32_t read32(const char* data, std::size_t offset)
+{
+    std::uint32_t value;
+    std::memcpy(&value, data + offset, sizeof(value));
+    return value;
+}
+
+void write32(char* data, std::size_t offset, std::uint32_t value)
+{
+    std::memcpy(data + offset, &value, sizeof(value));
+}
+
+// Keeps a read only mapping of a whole file open
+struct MappedFile
+{
+    explicit MappedFile(const QString& fileName) : file{ fileName } {}
+
+    ~MappedFile()
+    {
+        if (data) {
+            file.unmap(data);
+        }
+    }
+
+    QFile file;
+    uchar* data = nullptr;
+};
+
+gli::target arrayTarget(gli::target target)
+{
+    switch (target) {
+    case gli::TARGET_1D:
+        return gli::TARGET_1D_ARRAY;
+    case gli::TARGET_2D:
+        return gli::TARGET_2D_ARRAY;
+    case gli::TARGET_CUBE:
+        return gli::TARGET_CUBE_ARRAY;
+    default:
+        return target;
+    }
+}
+}
+
+TextureData DdsLoader::load(const QString& fileName, int maxSize)
+{
+    auto mapped = std::make_shared<MappedFile>(fileName);
+    if (!mapped->file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+
+    auto size = mapped->file.size();
+    mapped->data = size > 0 ? mapped->file.map(0, size) : nullptr;
+    if (!mapped->data) {
+        return {};
+    }
+
+    auto data = reinterpret_cast<const char*>(mapped->data);
+    return view(std::move(mapped), data, static_cast<std::size_t>(size), maxSize);
+}
+
+TextureData DdsLoader::load(const QByteArray& data, int maxSize)
+{
+    // The copy shares the extracted bytes instead of duplicating them
+    auto owner = std::make_shared<const QByteArray>(data);
+    auto bytes = owner->constData();
+    return view(std::move(owner), bytes, static_cast<std::size_t>(data.size()), maxSize);
+}
+
+TextureData DdsLoader::view(
+    std::shared_ptr<const void> owner,
+    const char* data,
+    std::size_t size,
+    int maxSize)
+{
+    auto layout = parseHeader(data, size);
+
+    // Files that are cut short or that the header parsing doesn't cover are left to gli;
+    // the header checked that the data offset fits and bounded the counts
+    auto images = layout ? layout->layers * layout->faces : 0;
+    if (!layout || images == 0 ||
+        TextureData::chainSize(*layout) > (size - layout->dataOffset) / images) {
+        return TextureData{ gli::load(data, size) };
+    }
+
+    layout->baseLevel = baseLevel(*layout, maxSize);
+    return TextureData{ std::move(owner), data, *layout };
+}
+
+std::optional<TextureData::Layout> DdsLoader::parseHeader(const char* data, std::size_t size)
+{
+    if (size < HeaderSize || std::memcmp(data, "DDS ", 4) != 0) {
+        return std::nullopt;
+    }
+
+    TextureData::Layout layout;
+
+    auto flags = read32(data, FlagsOffset);
+    bool dx10 = (read32(data, FormatFlagsOffset) & DDPF_FOURCC) &&
+                read32(data, FourCCOffset) == FourCC_DX10;
+
+    layout.dataOffset = dx10 ? HeaderDX10Size : HeaderSize;
+    if (size < layout.dataOffset) {
+        return std::nullopt;
+    }
+
+    auto readExtent = [data](std::size_t offset) {
+        return std::max<std::uint32_t>(read32(data, offset), 1);
+    };
+
+    auto width = readExtent(WidthOffset);
+    auto height = readExtent(HeightOffset);
+    auto depth = (flags & DDSD_DEPTH) ? readExtent(DepthOffset) : 1;
+    auto levels = (flags & DDSD_MIPMAPCOUNT) ? readExtent(MipMapCountOffset) : 1;
+    auto layers = dx10 ? readExtent(ArraySizeOffset) : 1;
+
+    // Broken files can claim more levels than the extent allows, or sizes that
+    // don't fit the extent's ints
+    if (std::max({ width, height, depth }) > MaxExtent || layers > MaxLayers || levels > 32) {
+        return std::nullopt;
+    }
+
+    layout.extent = gli::extent3d(width, height, depth);
+    layout.levels = levels;
+    layout.layers = layers;
+
+    // gli decides the format, swizzles and face count from a copy describing a single
+    // 1x1 level, which keeps the interpretation identical to loading the whole file
+    std::array<char, HeaderDX10Size + 256> probe{};
+    std::memcpy(probe.data(), data, layout.dataOffset);
+    write32(probe.data(), WidthOffset, 1);
+    write32(probe.data(), HeightOffset, 1);
+    write32(probe.data(), DepthOffset, 1);
+    write32(probe.data(), MipMapCountOffset, 1);
+    write32(probe.data(), FlagsOffset, flags | DDSD_MIPMAPCOUNT);
+    if (dx10) {
+        write32(probe.data(), ArraySizeOffset, 1);
+    }
+
+    auto probeTexture = gli::load(probe.data(), layout.dataOffset + 256);
+    if (probeTexture.empty()) {
+        return std::nullopt;
+    }
+
+    layout.format = probeTexture.format();
+    layout.swizzles = probeTexture.swizzles();
+    layout.faces = probeTexture.faces();
+    layout.target = layout.layers > 1 ? arrayTarget(probeTexture.target())
+                                      : probeTexture.target();
+
+    return layout;
+}
+
+std::size_t DdsLoader::baseLevel(const TextureData::Layout& layout, int maxSize)
+{
+    if (maxSize <= 0) {
+        return 0;
+    }
+
+    std::size_t base = 0;
+    auto largest = std::max({ layout.extent.x, layout.extent.y, layout.extent.z });
+    auto limit = static_cast<std::uint32_t>(maxSize);
+
+    while (base + 1 < layout.levels && (static_cast<std::uint32_t>(largest) >> base) > limit) {
+        base++;
+    }
+
+    return base;
+}
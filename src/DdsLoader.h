@@ -0,0 +1,31 @@
+#pragma once
+
+#include "TextureData.h"
+
+#include <QByteArray>
+#include <QString>
+
+#include <cstddef>
+#include <optional>
+
+// Loads DDS textures starting from a smaller mip level, so previews don't read or upload
+// resolution they can't show. gli decides the format from the header, but level data
+// is never copied: loose files are memory mapped and archive entries are used where
+// they were extracted, and the returned data points into them until it is uploaded.
+class DdsLoader
+{
+public:
+    // maxSize limits the largest dimension of the base level, 0 loads every level
+    static TextureData load(const QString& fileName, int maxSize);
+    static TextureData load(const QByteArray& data, int maxSize);
+
+private:
+    static TextureData view(
+        std::shared_ptr<const void> owner,
+        const char* data,
+        std::size_t size,
+        int maxSize);
+
+    static std::optional<TextureData::Layout> parseHeader(const char* data, std::size_t size);
+    static std::size_t baseLevel(const TextureData::Layout& layout, int maxSize);
+};
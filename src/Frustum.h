@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+#include <array>
+
+// View frustum planes extracted from a combined projection and view matrix, used
+// to skip shapes whose bounding sphere is entirely off-screen
+class Frustum
+{
+public:
+    Frustum() = default;
+
+    explicit Frustum(const QMatrix4x4& viewProjection)
+    {
+        auto x = viewProjection.row(0);
+        auto y = viewProjection.row(1);
+        auto z = viewProjection.row(2);
+        auto w = viewProjection.row(3);
+
+        m_Planes = { w + x, w - x, w + y, w - y, w + z, w - z };
+
+        for (auto& plane : m_Planes) {
+            float length = plane.toVector3D().length();
+            if (length > 0.0f) {
+                plane /= length;
+            }
+        }
+    }
+
+    bool intersectsSphere(const QVector3D& center, float radius) const
+    {
+        for (auto& plane : m_Planes) {
+            if (QVector3D::dotProduct(plane.toVector3D(), center) + plane.w() < -radius) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+private:
+    std::array<QVector4D, 6> m_Planes;
+};
@@ -0,0 +1,417 @@
+#include "GeometryBuffer.h"
+#include "MeshOptimizer.h"
+#include "ShaderManager.h"
+#include "TangentFrame.h"
+#include "Trace.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <QOpenGLFunctions_2_1>
+#include <QOpenGLVersionFunctionsFactory>
+#include <QThreadPool>
+
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+
+#ifndef GL_HALF_FLOAT
+#define GL_HALF_FLOAT 0x140B
+#endif
+
+inline static std::int8_t packSnorm(float value)
+{
+    return static_cast<std::int8_t>(std::lround(qBound(-1.0f, value, 1.0f) * 127.0f));
+}
+
+// BSTriShape stores the tangent frame as unsigned bytes mapping [0, 255] to [-1, 1]
+inline static std::int8_t packSnorm(std::uint8_t value)
+{
+    return packSnorm(value / 255.0f * 2.0f - 1.0f);
+}
+
+inline static std::uint8_t packUnorm(float value)
+{
+    return static_cast<std::uint8_t>(std::lround(qBound(0.0f, value, 1.0f) * 255.0f));
+}
+
+// Runs the jobs on idle threads of the global pool with the calling thread helping,
+// so it finishes even when the pool is busy
+template <typename Job>
+static void parallelFor(std::size_t count, Job&& job)
+{
+    std::atomic<std::size_t> next = 0;
+    auto summary = TraceSummary::current();
+
+    auto run = [&]() {
+        for (auto i = next++; i < count; i = next++) {
+            job(i);
+        }
+    };
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    int running = 0;
+
+    auto pool = QThreadPool::globalInstance();
+    auto helpers = qMin(static_cast<int>(count) - 1, pool->maxThreadCount());
+
+    for (int i = 0; i < helpers; i++) {
+        {
+            std::lock_guard lock{ mutex };
+            running++;
+        }
+
+        bool started = pool->tryStart([&]() {
+            {
+                TraceSummary::Bind bind{ summary };
+                run();
+            }
+
+            std::lock_guard lock{ mutex };
+            running--;
+            finished.notify_all();
+        });
+
+        if (!started) {
+            std::lock_guard lock{ mutex };
+            running--;
+            break;
+        }
+    }
+
+    run();
+
+    std::unique_lock lock{ mutex };
+    finished.wait(lock, [&]() { return running == 0; });
+}
+
+GeometryBuffer::GeometryBuffer(const VertexLayout& layout) : m_Layout{ layout } {}
+
+GeometryBuffer::Range GeometryBuffer::append(
+    nifly::NifFile* nifFile,
+    nifly::NiShape* niShape)
+{
+    Range range;
+    range.firstVertex = m_Vertices.size() / m_Layout.stride;
+    range.vertexCount = niShape->GetNumVertices();
+    range.firstIndex = m_Indices.size();
+    range.hasTexCoords = niShape->HasUVs();
+    range.hasColors = niShape->HasVertexColors();
+
+    m_Vertices.resize(m_Vertices.size() + range.vertexCount * m_Layout.stride);
+
+    if (std::vector<nifly::Triangle> tris; niShape->GetTriangles(tris)) {
+        static_assert(sizeof(nifly::Triangle) == 3 * sizeof(std::uint16_t));
+
+        auto indices = reinterpret_cast<const std::uint16_t*>(tris.data());
+        m_Indices.insert(m_Indices.end(), indices, indices + tris.size() * 3);
+    }
+
+    range.indexCount = m_Indices.size() - range.firstIndex;
+
+    m_Pending.push_back({ nifFile, niShape, range });
+    return range;
+}
+
+void GeometryBuffer::setStaged(std::vector<char> vertices, std::vector<std::uint16_t> indices)
+{
+    m_Vertices = std::move(vertices);
+    m_Indices = std::move(indices);
+}
+
+bool GeometryBuffer::upload()
+{
+    packPending();
+
+    bool uploaded =
+        upload(m_Vertices.data(), m_Vertices.size(), m_Indices.data(), m_Indices.size());
+
+    m_Vertices = {};
+    m_Indices = {};
+    return uploaded;
+}
+
+bool GeometryBuffer::upload(
+    const char* vertices,
+    std::size_t vertexSize,
+    const std::uint16_t* indices,
+    std::size_t indexCount)
+{
+    TraceScope scope{ "Upload geometry" };
+
+    if (!vertexBuffer.create() || !indexBuffer.create()) {
+        return false;
+    }
+
+    vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    vertexBuffer.bind();
+    vertexBuffer.allocate(vertices, static_cast<int>(vertexSize));
+    vertexBuffer.release();
+
+    indexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    indexBuffer.bind();
+    indexBuffer.allocate(indices, static_cast<int>(indexCount * sizeof(std::uint16_t)));
+    indexBuffer.release();
+
+    return true;
+}
+
+void GeometryBuffer::setConstantAttributes(QOpenGLContext* context)
+{
+    auto f = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_2_1>(context);
+
+    f->glVertexAttrib2f(AttribTexCoord, 0.0f, 0.0f);
+    f->glVertexAttrib4f(AttribColor, 1.0f, 1.0f, 1.0f, 1.0f);
+}
+
+void GeometryBuffer::destroy()
+{
+    vertexBuffer.destroy();
+    indexBuffer.destroy();
+}
+
+void GeometryBuffer::setupVertexArray(const Range& range, QOpenGLBuffer* elementBuffer)
+{
+    auto f = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_2_1>(
+        QOpenGLContext::currentContext());
+
+    vertexBuffer.bind();
+
+    auto base = reinterpret_cast<const char*>(range.firstVertex * m_Layout.stride);
+    auto stride = m_Layout.stride;
+
+    f->glVertexAttribPointer(
+        AttribPosition, 3, GL_FLOAT, GL_FALSE, stride, base + m_Layout.position);
+    f->glVertexAttribPointer(
+        AttribTexCoord, 2, m_Layout.halfTexCoord ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE,
+        stride, base + m_Layout.texCoord);
+    f->glVertexAttribPointer(
+        AttribNormal, 3, GL_BYTE, GL_TRUE, stride, base + m_Layout.normal);
+    f->glVertexAttribPointer(
+        AttribTangent, 3, GL_BYTE, GL_TRUE, stride, base + m_Layout.tangent);
+    f->glVertexAttribPointer(
+        AttribBitangent, 3, GL_BYTE, GL_TRUE, stride, base + m_Layout.bitangent);
+    f->glVertexAttribPointer(
+        AttribColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, base + m_Layout.color);
+
+    for (GLuint i = 0; i < ATTRIB_COUNT; i++) {
+        f->glEnableVertexAttribArray(i);
+    }
+
+    if (!range.hasTexCoords) {
+        f->glDisableVertexAttribArray(AttribTexCoord);
+    }
+
+    if (!range.hasColors) {
+        f->glDisableVertexAttribArray(AttribColor);
+    }
+
+    // The element array binding is part of the VAO state
+    if (elementBuffer) {
+        elementBuffer->bind();
+    }
+    else {
+        indexBuffer.bind();
+    }
+    vertexBuffer.release();
+}
+
+void GeometryBuffer::packPending()
+{
+    if (m_Pending.empty()) {
+        return;
+    }
+
+    TraceScope scope{ "Pack geometry" };
+
+    parallelFor(m_Pending.size(), [this](std::size_t i) { pack(m_Pending[i]); });
+    m_Pending.clear();
+}
+
+void GeometryBuffer::pack(const PendingShape& pending)
+{
+    auto& range = pending.range;
+    auto out = m_Vertices.data() + range.firstVertex * m_Layout.stride;
+
+    auto bsTriShape = dynamic_cast<nifly::BSTriShape*>(pending.niShape);
+    if (bsTriShape && bsTriShape->vertData.size() == range.vertexCount) {
+        packBSTriShape(bsTriShape, out);
+    }
+    else {
+        packGeometry(pending.nifFile, pending.niShape, out);
+    }
+
+    // Shapes without a tangent frame get one generated in the staging buffer; the
+    // NIF itself is left as it was loaded
+    bool normals = !pending.niShape->HasNormals();
+    bool tangents = !pending.niShape->HasTangents();
+    if (normals || tangents) {
+        TraceScope scope{ "Generate tangent frame" };
+        generateTangentFrame(
+            m_Layout,
+            out,
+            range.vertexCount,
+            m_Indices.data() + range.firstIndex,
+            range.indexCount,
+            normals,
+            tangents);
+    }
+
+    if (MeshOptimizer::instance().isEnabled()) {
+        TraceScope scope{ "Optimize mesh" };
+        optimize(range);
+    }
+}
+
+void GeometryBuffer::optimize(const Range& range)
+{
+    if (range.indexCount < 3 || range.vertexCount == 0) {
+        return;
+    }
+
+    auto stride = static_cast<std::size_t>(m_Layout.stride);
+    auto vertices = m_Vertices.data() + range.firstVertex * stride;
+    auto indices = m_Indices.data() + range.firstIndex;
+
+    auto result = MeshOptimizer::instance().optimize(
+        indices,
+        range.indexCount,
+        vertices + m_Layout.position,
+        range.vertexCount,
+        stride);
+
+    std::vector<char> reordered(range.vertexCount * stride);
+    for (std::size_t v = 0; v < range.vertexCount; v++) {
+        std::memcpy(reordered.data() + result->remap[v] * stride, vertices + v * stride, stride);
+    }
+    std::memcpy(vertices, reordered.data(), reordered.size());
+    std::copy(result->indices.begin(), result->indices.end(), indices);
+
+    qDebug(qUtf8Printable(QObject::tr("Optimized %1 triangles, ACMR %2 -> %3")
+                              .arg(range.indexCount / 3)
+                              .arg(result->acmrBefore, 0, 'f', 3)
+                              .arg(result->acmrAfter, 0, 'f', 3)));
+}
+
+void GeometryBuffer::packBSTriShape(nifly::BSTriShape* bsTriShape, char* out)
+{
+    auto dynamicShape = dynamic_cast<nifly::BSDynamicTriShape*>(bsTriShape);
+    bool hasColors = bsTriShape->HasVertexColors();
+
+    for (std::size_t i = 0; i < bsTriShape->vertData.size(); i++, out += m_Layout.stride) {
+        auto& vertex = bsTriShape->vertData[i];
+
+        float position[3] = { vertex.vert.x, vertex.vert.y, vertex.vert.z };
+        if (dynamicShape && i < dynamicShape->dynamicData.size()) {
+            auto& dynamic = dynamicShape->dynamicData[i];
+            position[0] = dynamic.x;
+            position[1] = dynamic.y;
+            position[2] = dynamic.z;
+        }
+        std::memcpy(out + m_Layout.position, position, sizeof(position));
+
+        if (m_Layout.halfTexCoord) {
+            std::uint16_t uv[2] = {
+                glm::packHalf1x16(vertex.uv.u),
+                glm::packHalf1x16(vertex.uv.v),
+            };
+            std::memcpy(out + m_Layout.texCoord, uv, sizeof(uv));
+        }
+        else {
+            float uv[2] = { vertex.uv.u, vertex.uv.v };
+            std::memcpy(out + m_Layout.texCoord, uv, sizeof(uv));
+        }
+
+        auto normal = reinterpret_cast<std::int8_t*>(out + m_Layout.normal);
+        auto tangent = reinterpret_cast<std::int8_t*>(out + m_Layout.tangent);
+        auto bitangent = reinterpret_cast<std::int8_t*>(out + m_Layout.bitangent);
+        for (int j = 0; j < 3; j++) {
+            normal[j] = packSnorm(vertex.normal[j]);
+            tangent[j] = packSnorm(vertex.tangent[j]);
+        }
+        bitangent[0] = packSnorm(vertex.bitangentX);
+        bitangent[1] = packSnorm(vertex.bitangentY);
+        bitangent[2] = packSnorm(vertex.bitangentZ);
+
+        auto color = reinterpret_cast<std::uint8_t*>(out + m_Layout.color);
+        if (hasColors) {
+            std::memcpy(color, vertex.colorData, 4);
+        }
+        else {
+            std::memset(color, 0xFF, 4);
+        }
+    }
+}
+
+void GeometryBuffer::packGeometry(
+    nifly::NifFile* nifFile,
+    nifly::NiShape* niShape,
+    char* out)
+{
+    auto vertexCount = niShape->GetNumVertices();
+
+    auto verts = nifFile->GetVertsForShape(niShape);
+    auto normals = nifFile->GetNormalsForShape(niShape);
+    auto tangents = nifFile->GetTangentsForShape(niShape);
+    auto bitangents = nifFile->GetBitangentsForShape(niShape);
+    auto uvs = nifFile->GetUvsForShape(niShape);
+
+    std::vector<nifly::Color4> colors;
+    nifFile->GetColorsForShape(niShape, colors);
+
+    auto packVector3 = [](const std::vector<nifly::Vector3>* data, std::size_t i, char* out) {
+        auto packed = reinterpret_cast<std::int8_t*>(out);
+        if (data && i < data->size()) {
+            packed[0] = packSnorm((*data)[i].x);
+            packed[1] = packSnorm((*data)[i].y);
+            packed[2] = packSnorm((*data)[i].z);
+        }
+        else {
+            packed[0] = packed[1] = packed[2] = 0;
+        }
+    };
+
+    for (std::size_t i = 0; i < vertexCount; i++, out += m_Layout.stride) {
+        float position[3] = { 0.0f, 0.0f, 0.0f };
+        if (verts && i < verts->size()) {
+            position[0] = (*verts)[i].x;
+            position[1] = (*verts)[i].y;
+            position[2] = (*verts)[i].z;
+        }
+        std::memcpy(out + m_Layout.position, position, sizeof(position));
+
+        nifly::Vector2 uv;
+        if (uvs && i < uvs->size()) {
+            uv = (*uvs)[i];
+        }
+
+        if (m_Layout.halfTexCoord) {
+            std::uint16_t packed[2] = {
+                glm::packHalf1x16(uv.u),
+                glm::packHalf1x16(uv.v),
+            };
+            std::memcpy(out + m_Layout.texCoord, packed, sizeof(packed));
+        }
+        else {
+            float packed[2] = { uv.u, uv.v };
+            std::memcpy(out + m_Layout.texCoord, packed, sizeof(packed));
+        }
+
+        packVector3(normals, i, out + m_Layout.normal);
+        packVector3(tangents, i, out + m_Layout.tangent);
+        packVector3(bitangents, i, out + m_Layout.bitangent);
+
+        auto color = reinterpret_cast<std::uint8_t*>(out + m_Layout.color);
+        if (i < colors.size()) {
+            color[0] = packUnorm(colors[i].r);
+            color[1] = packUnorm(colors[i].g);
+            color[2] = packUnorm(colors[i].b);
+            color[3] = packUnorm(colors[i].a);
+        }
+        else {
+            std::memset(color, 0xFF, 4);
+        }
+    }
+}
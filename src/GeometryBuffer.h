@@ -0,0 +1,89 @@
+#pragma once
+
+#include "VertexLayout.h"
+
+#include <NifFile.hpp>
+
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+
+#include <cstdint>
+#include <vector>
+
+// Vertex and index storage for every shape of a NIF, suballocated from one vertex
+// buffer and one index buffer
+class GeometryBuffer
+{
+public:
+    struct Range
+    {
+        std::size_t firstVertex = 0;
+        std::size_t vertexCount = 0;
+        std::size_t firstIndex = 0;
+        std::size_t indexCount = 0;
+
+        // Missing UVs and colors are read from constant attributes instead
+        bool hasTexCoords = true;
+        bool hasColors = true;
+    };
+
+    explicit GeometryBuffer(const VertexLayout& layout);
+
+    // Reserves the shape's vertices in the staging buffer and copies its indices. The
+    // vertices are packed by upload, so the NIF must outlive that call; it is only read.
+    Range append(nifly::NifFile* nifFile, nifly::NiShape* niShape);
+
+    // Packs the appended shapes in parallel; upload does this for shapes still pending
+    void packPending();
+
+    // Staged vertices and indices, complete once packed and released by upload
+    const std::vector<char>& stagedVertices() const { return m_Vertices; }
+    const std::vector<std::uint16_t>& stagedIndices() const { return m_Indices; }
+
+    // Replaces the packed staged data, for passes that rebuild the shapes' ranges
+    void setStaged(std::vector<char> vertices, std::vector<std::uint16_t> indices);
+
+    // Creates the GL buffers from the staged data and releases the staging memory
+    bool upload();
+
+    // Creates the GL buffers from data packed earlier with the same layout, such as
+    // the mesh cache
+    bool upload(
+        const char* vertices,
+        std::size_t vertexSize,
+        const std::uint16_t* indices,
+        std::size_t indexCount);
+
+    void destroy();
+
+    // Points the vertex attributes at the range; requires the shape's VAO to be bound.
+    // The element buffer replaces the shared index buffer, for reduced detail indices.
+    void setupVertexArray(const Range& range, QOpenGLBuffer* elementBuffer = nullptr);
+
+    const VertexLayout& layout() const { return m_Layout; }
+
+    // Sets the values used by ranges without UVs or colors; these aren't VAO state
+    static void setConstantAttributes(QOpenGLContext* context);
+
+    QOpenGLBuffer vertexBuffer{ QOpenGLBuffer::VertexBuffer };
+    QOpenGLBuffer indexBuffer{ QOpenGLBuffer::IndexBuffer };
+
+private:
+    struct PendingShape
+    {
+        nifly::NifFile* nifFile;
+        nifly::NiShape* niShape;
+        Range range;
+    };
+
+    void pack(const PendingShape& pending);
+    void optimize(const Range& range);
+    void packBSTriShape(nifly::BSTriShape* bsTriShape, char* out);
+    void packGeometry(nifly::NifFile* nifFile, nifly::NiShape* niShape, char* out);
+
+    VertexLayout m_Layout;
+
+    std::vector<char> m_Vertices;
+    std::vector<std::uint16_t> m_Indices;
+    std::vector<PendingShape> m_Pending;
+};
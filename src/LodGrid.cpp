@@ -0,0 +1,161 @@
+#include "LodGrid.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QRegularExpression>
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+namespace
+{
+struct TileName
+{
+    QString worldspace;
+    int level = 0;
+    int x = 0;
+    int y = 0;
+};
+
+std::optional<TileName> parseTileName(const QString& fileName)
+{
+    static const QRegularExpression pattern{
+        R"(^(.+)\.(\d+)\.(-?\d+)\.(-?\d+)\.(bto|btr)$)",
+        QRegularExpression::CaseInsensitiveOption };
+
+    auto match = pattern.match(fileName);
+    if (!match.hasMatch()) {
+        return std::nullopt;
+    }
+
+    TileName name;
+    name.worldspace = match.captured(1);
+    name.level = match.captured(2).toInt();
+    name.x = match.captured(3).toInt();
+    name.y = match.captured(4).toInt();
+
+    if (name.level <= 0) {
+        return std::nullopt;
+    }
+
+    return name;
+}
+
+int floorDiv(int value, int divisor)
+{
+    return value / divisor - (value % divisor < 0 ? 1 : 0);
+}
+}
+
+std::shared_ptr<LodGrid> LodGrid::scan(const QString& fileName)
+{
+    QFileInfo info{ fileName };
+    auto name = parseTileName(info.fileName());
+    if (!name) {
+        return nullptr;
+    }
+
+    std::shared_ptr<LodGrid> grid{ new LodGrid() };
+    grid->m_Worldspace = name->worldspace;
+    grid->m_Level = name->level;
+
+    // Terrain LOD sits in terrain/<worldspace>, object LOD in its objects folder
+    auto directory = info.absoluteDir();
+    QList<QDir> directories{ directory };
+    if (directory.dirName().compare("objects", Qt::CaseInsensitive) == 0) {
+        directories.append(QDir(directory.absoluteFilePath("..")));
+    }
+    else if (directory.exists("objects")) {
+        directories.append(QDir(directory.absoluteFilePath("objects")));
+    }
+
+    for (auto& dir : directories) {
+        auto entries = dir.entryInfoList({ "*.bto", "*.btr" }, QDir::Files);
+        for (auto& entry : entries) {
+            auto tileName = parseTileName(entry.fileName());
+            if (!tileName || tileName->level != grid->m_Level ||
+                tileName->worldspace.compare(grid->m_Worldspace, Qt::CaseInsensitive) != 0) {
+                continue;
+            }
+
+            auto& tile = grid->m_Tiles[grid->key(tileName->x, tileName->y)];
+            tile.x = tileName->x;
+            tile.y = tileName->y;
+            tile.files.append(QDir::cleanPath(entry.absoluteFilePath()));
+        }
+    }
+
+    return grid;
+}
+
+QVector3D LodGrid::origin(const Tile& tile) const
+{
+    return QVector3D(tile.x * CellSize, tile.y * CellSize, 0.0f);
+}
+
+const LodGrid::Tile* LodGrid::find(const QString& fileName) const
+{
+    auto name = parseTileName(QFileInfo(fileName).fileName());
+    if (!name) {
+        return nullptr;
+    }
+
+    auto it = m_Tiles.find(key(name->x, name->y));
+    return it != m_Tiles.end() ? &it->second : nullptr;
+}
+
+std::vector<const LodGrid::Tile*> LodGrid::query(const QVector2D& center, float radius) const
+{
+    auto size = tileSize();
+    auto first = [&](float value) {
+        return static_cast<int>(std::floor((value - radius) / size));
+    };
+    auto last = [&](float value) {
+        return static_cast<int>(std::floor((value + radius) / size));
+    };
+
+    std::vector<std::pair<float, const Tile*>> found;
+    for (int x = first(center.x()); x <= last(center.x()); x++) {
+        for (int y = first(center.y()); y <= last(center.y()); y++) {
+            auto it = m_Tiles.find(key(x * m_Level, y * m_Level));
+            if (it == m_Tiles.end()) {
+                continue;
+            }
+
+            auto tileDistance = distance(it->second, center);
+            if (tileDistance <= radius) {
+                found.emplace_back(tileDistance, &it->second);
+            }
+        }
+    }
+
+    std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+
+    std::vector<const Tile*> tiles;
+    tiles.reserve(found.size());
+    for (auto& [tileDistance, tile] : found) {
+        tiles.push_back(tile);
+    }
+
+    return tiles;
+}
+
+float LodGrid::distance(const Tile& tile, const QVector2D& position) const
+{
+    auto min = origin(tile).toVector2D();
+    auto max = min + QVector2D(tileSize(), tileSize());
+
+    auto dx = std::max({ min.x() - position.x(), 0.0f, position.x() - max.x() });
+    auto dy = std::max({ min.y() - position.y(), 0.0f, position.y() - max.y() });
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+std::uint64_t LodGrid::key(int x, int y) const
+{
+    auto column = static_cast<std::uint32_t>(floorDiv(x, m_Level));
+    auto row = static_cast<std::uint32_t>(floorDiv(y, m_Level));
+    return (static_cast<std::uint64_t>(column) << 32) | row;
+}
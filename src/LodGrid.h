@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QVector2D>
+#include <QVector3D>
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// The tiles of one worldspace LOD level, found by their file names
+// (<worldspace>.<level>.<x>.<y>.btr or .bto) and indexed by their position in cells
+class LodGrid
+{
+public:
+    inline static constexpr float CellSize = 4096.0f;
+
+    struct Tile
+    {
+        // Cell of the tile's south west corner, which its vertices are relative to
+        int x = 0;
+        int y = 0;
+
+        // Terrain and object LOD of the tile
+        QStringList files;
+    };
+
+    // Collects the tiles of the file's worldspace and level from its folder and the
+    // terrain or objects folder next to it; nullptr if the file isn't a LOD tile
+    static std::shared_ptr<LodGrid> scan(const QString& fileName);
+
+    const QString& worldspace() const { return m_Worldspace; }
+    int level() const { return m_Level; }
+    std::size_t size() const { return m_Tiles.size(); }
+
+    float tileSize() const { return m_Level * CellSize; }
+    QVector3D origin(const Tile& tile) const;
+
+    // The tile the file belongs to, or nullptr
+    const Tile* find(const QString& fileName) const;
+
+    // Tiles overlapping the circle around a world position, nearest first
+    std::vector<const Tile*> query(const QVector2D& center, float radius) const;
+
+    // Distance from a world position to the nearest point of the tile
+    float distance(const Tile& tile, const QVector2D& position) const;
+
+private:
+    LodGrid() = default;
+
+    // Tiles are aligned to their size, so each grid square holds at most one
+    std::uint64_t key(int x, int y) const;
+
+    QString m_Worldspace;
+    int m_Level = 0;
+    std::unordered_map<std::uint64_t, Tile> m_Tiles;
+};
@@ -0,0 +1,248 @@
+#include "MeshCache.h"
+#include "Trace.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QThreadPool>
+
+#include <algorithm>
+
+inline static constexpr quint32 CacheMagic = 0x434D4E50; // 'PNMC'
+// Bumped whenever the file layout, OpenGLShape's stream format or the shader types change
+inline static constexpr quint32 CacheVersion = 3;
+
+// Magic, version and the offsets of the vertex and index data
+inline static constexpr qint64 HeaderSize = 2 * sizeof(quint32) + 4 * sizeof(quint64);
+inline static constexpr qint64 DataAlignment = 16;
+
+CachedMesh::Stats CachedMesh::Stats::count(nifly::NifFile* nifFile)
+{
+    Stats stats;
+    for (auto& shape : nifFile->GetShapes()) {
+        stats.shapes++;
+        stats.faces += shape->GetNumTriangles();
+        stats.vertices += shape->GetNumVertices();
+    }
+
+    return stats;
+}
+
+CachedMesh::~CachedMesh()
+{
+    if (m_Data) {
+        m_File.unmap(m_Data);
+    }
+}
+
+MeshCache& MeshCache::instance()
+{
+    static MeshCache cache;
+    return cache;
+}
+
+void MeshCache::setDirectory(const QString& directory, qint64 maxBytes)
+{
+    std::lock_guard lock{ m_Mutex };
+    m_Directory = directory;
+    m_MaxBytes = maxBytes;
+}
+
+std::shared_ptr<CachedMesh> MeshCache::load(const QString& fileName)
+{
+    auto path = cacheFile(fileName);
+    if (path.isEmpty()) {
+        return nullptr;
+    }
+
+    TraceScope scope{ "Read mesh cache" };
+
+    std::shared_ptr<CachedMesh> mesh{ new CachedMesh(path) };
+    if (!mesh->m_File.open(QIODevice::ReadOnly)) {
+        return nullptr;
+    }
+
+    auto size = mesh->m_File.size();
+    mesh->m_Data = size >= HeaderSize ? mesh->m_File.map(0, size) : nullptr;
+    if (!mesh->m_Data) {
+        return nullptr;
+    }
+
+    auto bytes = reinterpret_cast<const char*>(mesh->m_Data);
+    auto data = QByteArray::fromRawData(bytes, size);
+    QDataStream stream{ data };
+
+    quint32 magic, version;
+    quint64 vertexOffset, vertexSize, indexOffset, indexCount;
+    stream >> magic >> version >> vertexOffset >> vertexSize >> indexOffset >> indexCount;
+
+    auto fileSize = static_cast<quint64>(size);
+    if (magic != CacheMagic || version != CacheVersion || vertexOffset > fileSize ||
+        vertexSize > fileSize - vertexOffset || indexOffset > fileSize ||
+        indexCount > (fileSize - indexOffset) / sizeof(std::uint16_t)) {
+        return nullptr;
+    }
+
+    qint32 stride;
+    quint32 shapeCount;
+    auto& stats = mesh->m_Stats;
+    stream >> mesh->m_HalfTexCoord >> stride >> stats.vertices >> stats.faces >>
+        stats.shapes >> shapeCount;
+
+    auto layout = VertexLayout::create(mesh->m_HalfTexCoord);
+    if (stream.status() != QDataStream::Ok || stride != layout.stride ||
+        shapeCount > fileSize) {
+        return nullptr;
+    }
+
+    auto vertexCount = vertexSize / layout.stride;
+    auto indices = reinterpret_cast<const std::uint16_t*>(bytes + indexOffset);
+    for (quint32 i = 0; i < shapeCount && stream.status() == QDataStream::Ok; i++) {
+        auto& shape = mesh->m_Shapes.emplace_back();
+        stream >> shape;
+        if (stream.status() != QDataStream::Ok) {
+            return nullptr;
+        }
+
+        // A damaged file mustn't point the draws outside the buffers
+        auto& geometry = shape.geometry;
+        if (geometry.firstVertex > vertexCount ||
+            geometry.vertexCount > vertexCount - geometry.firstVertex ||
+            geometry.firstIndex > indexCount ||
+            geometry.indexCount > indexCount - geometry.firstIndex) {
+            return nullptr;
+        }
+
+        auto first = indices + geometry.firstIndex;
+        auto last = first + geometry.indexCount;
+        if (std::any_of(first, last, [&](std::uint16_t index) {
+                return index >= geometry.vertexCount;
+            })) {
+            return nullptr;
+        }
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        return nullptr;
+    }
+
+    mesh->m_Vertices = bytes + vertexOffset;
+    mesh->m_VertexSize = vertexSize;
+    mesh->m_Indices = indices;
+    mesh->m_IndexCount = indexCount;
+
+    return mesh;
+}
+
+void MeshCache::store(
+    const QString& fileName,
+    const GeometryBuffer& geometryBuffer,
+    const std::vector<OpenGLShape>& shapes,
+    const CachedMesh::Stats& stats,
+    std::function<void()> onStored)
+{
+    auto path = cacheFile(fileName);
+    if (path.isEmpty()) {
+        return;
+    }
+
+    auto& layout = geometryBuffer.layout();
+
+    QByteArray meta;
+    {
+        QDataStream stream{ &meta, QIODevice::WriteOnly };
+        stream << layout.halfTexCoord << static_cast<qint32>(layout.stride) << stats.vertices
+               << stats.faces << stats.shapes << static_cast<quint32>(shapes.size());
+
+        for (auto& shape : shapes) {
+            stream << shape;
+        }
+    }
+
+    // Writing happens off the GUI thread, so it works on copies of the staged data
+    auto vertices = geometryBuffer.stagedVertices();
+    auto indices = geometryBuffer.stagedIndices();
+
+    QThreadPool::globalInstance()->start(
+        [this,
+         path,
+         meta,
+         vertices = std::move(vertices),
+         indices = std::move(indices),
+         onStored = std::move(onStored)]() {
+            auto metaEnd = static_cast<quint64>(HeaderSize + meta.size());
+            auto vertexOffset = (metaEnd + DataAlignment - 1) / DataAlignment * DataAlignment;
+            auto vertexSize = static_cast<quint64>(vertices.size());
+            auto indexOffset = vertexOffset + vertexSize;
+
+            QDir().mkpath(QFileInfo(path).absolutePath());
+
+            QSaveFile file{ path };
+            if (!file.open(QIODevice::WriteOnly)) {
+                return;
+            }
+
+            QDataStream stream{ &file };
+            stream << CacheMagic << CacheVersion << vertexOffset << vertexSize
+                   << indexOffset << static_cast<quint64>(indices.size());
+
+            stream.writeRawData(meta.constData(), meta.size());
+
+            QByteArray padding(static_cast<int>(vertexOffset - metaEnd), '\0');
+            stream.writeRawData(padding.constData(), padding.size());
+
+            stream.writeRawData(vertices.data(), static_cast<int>(vertices.size()));
+            stream.writeRawData(
+                reinterpret_cast<const char*>(indices.data()),
+                static_cast<int>(indices.size() * sizeof(std::uint16_t)));
+
+            if (stream.status() == QDataStream::Ok && file.commit()) {
+                trim();
+
+                if (onStored) {
+                    onStored();
+                }
+            }
+        });
+}
+
+QString MeshCache::cacheFile(const QString& fileName)
+{
+    std::lock_guard lock{ m_Mutex };
+    if (m_Directory.isEmpty()) {
+        return QString();
+    }
+
+    QFileInfo info{ fileName };
+    if (!info.isFile()) {
+        return QString();
+    }
+
+    // Replacing or editing the NIF changes its size or modification time
+    auto identity = QString("%1|%2|%3")
+                        .arg(QDir::cleanPath(info.absoluteFilePath()).toLower())
+                        .arg(info.size())
+                        .arg(info.lastModified().toMSecsSinceEpoch());
+
+    auto hash = QCryptographicHash::hash(identity.toUtf8(), QCryptographicHash::Sha1);
+    return QDir(m_Directory).filePath(QString("%1.mesh").arg(QString::fromLatin1(hash.toHex())));
+}
+
+void MeshCache::trim()
+{
+    std::lock_guard lock{ m_Mutex };
+
+    auto files = QDir(m_Directory).entryInfoList({ "*.mesh" }, QDir::Files, QDir::Time);
+
+    // Newest first, so everything past the budget is the oldest
+    qint64 size = 0;
+    for (auto& info : files) {
+        size += info.size();
+        if (size > m_MaxBytes) {
+            QFile::remove(info.absoluteFilePath());
+        }
+    }
+}
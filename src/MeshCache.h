@@ -0,0 +1,110 @@
+#pragma once
+
+#include "GeometryBuffer.h"
+#include "OpenGLShape.h"
+
+#include <NifFile.hpp>
+
+#include <QFile>
+#include <QString>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Render-ready meshes of a NIF read back from the mesh cache. The packed vertices and
+// optimized indices stay in the memory mapped file until they are uploaded.
+class CachedMesh
+{
+public:
+    struct Stats
+    {
+        int vertices = 0;
+        int faces = 0;
+        int shapes = 0;
+
+        static Stats count(nifly::NifFile* nifFile);
+    };
+
+    ~CachedMesh();
+    CachedMesh(const CachedMesh&) = delete;
+    CachedMesh(CachedMesh&&) = delete;
+    CachedMesh& operator=(const CachedMesh&) = delete;
+    CachedMesh& operator=(CachedMesh&&) = delete;
+
+    const Stats& stats() const { return m_Stats; }
+
+    // Vertices are packed for a context with this texture coordinate format
+    bool halfTexCoord() const { return m_HalfTexCoord; }
+
+    // Shapes without GL resources, with ranges into the cached buffers
+    const std::vector<OpenGLShape>& shapes() const { return m_Shapes; }
+
+    const char* vertices() const { return m_Vertices; }
+    std::size_t vertexSize() const { return m_VertexSize; }
+    const std::uint16_t* indices() const { return m_Indices; }
+    std::size_t indexCount() const { return m_IndexCount; }
+
+private:
+    friend class MeshCache;
+
+    explicit CachedMesh(const QString& fileName) : m_File{ fileName } {}
+
+    QFile m_File;
+    uchar* m_Data = nullptr;
+
+    Stats m_Stats;
+    bool m_HalfTexCoord = true;
+    std::vector<OpenGLShape> m_Shapes;
+
+    const char* m_Vertices = nullptr;
+    std::size_t m_VertexSize = 0;
+    const std::uint16_t* m_Indices = nullptr;
+    std::size_t m_IndexCount = 0;
+};
+
+// Keeps render-ready copies of previewed NIFs on disk, keyed by the file's path, size
+// and modification time, so opening a NIF again skips nifly along with tangent frame
+// generation and mesh optimization
+class MeshCache
+{
+public:
+    static MeshCache& instance();
+
+    MeshCache(const MeshCache&) = delete;
+    MeshCache(MeshCache&&) = delete;
+    MeshCache& operator=(const MeshCache&) = delete;
+    MeshCache& operator=(MeshCache&&) = delete;
+
+    // An empty directory disables the cache; the oldest files are removed once the
+    // cache grows beyond maxBytes
+    void setDirectory(const QString& directory, qint64 maxBytes);
+
+    // Returns nullptr if the file isn't cached or changed since; thread safe
+    std::shared_ptr<CachedMesh> load(const QString& fileName);
+
+    // Writes the shapes and the geometry buffer's staged data in the background;
+    // requires the buffer to be packed and not uploaded yet. onStored is called on the
+    // writing thread once the file is complete, and not at all if it couldn't be written.
+    void store(
+        const QString& fileName,
+        const GeometryBuffer& geometryBuffer,
+        const std::vector<OpenGLShape>& shapes,
+        const CachedMesh::Stats& stats,
+        std::function<void()> onStored = {});
+
+private:
+    MeshCache() = default;
+    ~MeshCache() = default;
+
+    // Empty if the cache is disabled or the file can't be read
+    QString cacheFile(const QString& fileName);
+
+    void trim();
+
+    std::mutex m_Mutex;
+    QString m_Directory;
+    qint64 m_MaxBytes = 0;
+};
@@ -0,0 +1,410 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+// Tuning from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+inline static constexpr int CacheSize = 32;
+inline static constexpr float CacheDecayPower = 1.5f;
+inline static constexpr float LastTriScore = 0.75f;
+inline static constexpr float ValenceBoostScale = 2.0f;
+inline static constexpr float ValenceBoostPower = 0.5f;
+
+// Overdraw ordering is only kept if it doesn't cost more than this in ACMR
+inline static constexpr float OverdrawThreshold = 1.05f;
+
+inline static float vertexScore(int cachePosition, std::uint32_t liveTriangles)
+{
+    if (liveTriangles == 0) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            score = LastTriScore;
+        }
+        else {
+            const float scale = 1.0f / (CacheSize - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scale, CacheDecayPower);
+        }
+    }
+
+    score += ValenceBoostScale * std::pow(
+        static_cast<float>(liveTriangles), -ValenceBoostPower);
+    return score;
+}
+
+inline static std::uint64_t hashBytes(std::uint64_t hash, const void* data, std::size_t size)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+inline static std::array<float, 3> readPosition(
+    const char* vertices,
+    std::size_t stride,
+    std::size_t index)
+{
+    std::array<float, 3> position;
+    std::memcpy(position.data(), vertices + index * stride, sizeof(position));
+    return position;
+}
+
+MeshOptimizer& MeshOptimizer::instance()
+{
+    static MeshOptimizer optimizer;
+    return optimizer;
+}
+
+std::shared_ptr<const MeshOptimizer::Result> MeshOptimizer::optimize(
+    const std::uint16_t* indices,
+    std::size_t indexCount,
+    const char* vertices,
+    std::size_t vertexCount,
+    std::size_t vertexStride)
+{
+    auto key = hashBytes(0xCBF29CE484222325ULL, indices, indexCount * sizeof(std::uint16_t));
+    for (std::size_t i = 0; i < vertexCount; i++) {
+        key = hashBytes(key, vertices + i * vertexStride, 3 * sizeof(float));
+    }
+
+    {
+        std::lock_guard lock{ m_Mutex };
+        auto cached = m_Results.find(key);
+        if (cached != m_Results.end()) {
+            m_Recent.remove(key);
+            m_Recent.push_front(key);
+            return cached->second;
+        }
+    }
+
+    auto result = std::make_shared<Result>();
+    result->acmrBefore = computeACMR(indices, indexCount, vertexCount);
+
+    result->indices = optimizeVertexCache(indices, indexCount, vertexCount);
+    optimizeOverdraw(result->indices, vertices, vertexCount, vertexStride);
+    result->remap = optimizeVertexFetch(result->indices, vertexCount);
+
+    result->acmrAfter = computeACMR(result->indices.data(), indexCount, vertexCount);
+
+    std::lock_guard lock{ m_Mutex };
+    if (m_Results.size() >= MaxCachedResults) {
+        m_Results.erase(m_Recent.back());
+        m_Recent.pop_back();
+    }
+
+    if (m_Results.emplace(key, result).second) {
+        m_Recent.push_front(key);
+    }
+
+    return result;
+}
+
+float MeshOptimizer::computeACMR(
+    const std::uint16_t* indices,
+    std::size_t indexCount,
+    std::size_t vertexCount,
+    std::size_t cacheSize)
+{
+    if (indexCount < 3) {
+        return 0.0f;
+    }
+
+    // Timestamps emulate a FIFO without moving entries around
+    std::vector<std::size_t> timestamps(vertexCount, 0);
+    std::size_t time = cacheSize + 1;
+    std::size_t misses = 0;
+
+    for (std::size_t i = 0; i < indexCount; i++) {
+        auto index = indices[i];
+        if (index >= vertexCount) {
+            continue;
+        }
+
+        if (time - timestamps[index] > cacheSize) {
+            timestamps[index] = time++;
+            misses++;
+        }
+    }
+
+    return static_cast<float>(misses) / (indexCount / 3);
+}
+
+std::vector<std::uint16_t> MeshOptimizer::optimizeVertexCache(
+    const std::uint16_t* indices,
+    std::size_t indexCount,
+    std::size_t vertexCount)
+{
+    const std::size_t triangleCount = indexCount / 3;
+
+    std::vector<std::uint32_t> liveTriangles(vertexCount, 0);
+    for (std::size_t i = 0; i < triangleCount * 3; i++) {
+        if (indices[i] >= vertexCount) {
+            return { indices, indices + indexCount };
+        }
+        liveTriangles[indices[i]]++;
+    }
+
+    // Triangles adjacent to each vertex; live ones are kept at the front
+    std::vector<std::uint32_t> offsets(vertexCount + 1, 0);
+    std::partial_sum(liveTriangles.begin(), liveTriangles.end(), offsets.begin() + 1);
+
+    std::vector<std::uint32_t> adjacency(triangleCount * 3);
+    {
+        std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (std::size_t i = 0; i < triangleCount * 3; i++) {
+            adjacency[fill[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> scores(vertexCount);
+    for (std::size_t v = 0; v < vertexCount; v++) {
+        scores[v] = vertexScore(-1, liveTriangles[v]);
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    for (std::size_t t = 0; t < triangleCount; t++) {
+        triangleScores[t] =
+            scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<std::uint32_t> cache;
+    std::vector<std::uint32_t> newCache;
+    cache.reserve(CacheSize + 3);
+    newCache.reserve(CacheSize + 3);
+
+    std::vector<std::uint16_t> result;
+    result.reserve(triangleCount * 3);
+
+    std::ptrdiff_t best = -1;
+    if (triangleCount > 0) {
+        best = std::max_element(triangleScores.begin(), triangleScores.end()) -
+               triangleScores.begin();
+    }
+
+    std::size_t scan = 0;
+    for (std::size_t n = 0; n < triangleCount; n++) {
+        if (best < 0) {
+            while (emitted[scan]) {
+                scan++;
+            }
+            best = static_cast<std::ptrdiff_t>(scan);
+        }
+
+        emitted[best] = true;
+
+        newCache.clear();
+        for (int k = 0; k < 3; k++) {
+            auto v = indices[best * 3 + k];
+            result.push_back(v);
+            newCache.push_back(v);
+
+            // Move the emitted triangle out of the live part of the vertex's list
+            auto begin = adjacency.begin() + offsets[v];
+            auto end = begin + liveTriangles[v];
+            auto it = std::find(begin, end, static_cast<std::uint32_t>(best));
+            if (it != end) {
+                std::iter_swap(it, end - 1);
+                liveTriangles[v]--;
+            }
+        }
+
+        for (auto v : cache) {
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+                newCache.push_back(v);
+            }
+        }
+
+        for (std::size_t i = 0; i < newCache.size(); i++) {
+            auto v = newCache[i];
+            cachePosition[v] = i < CacheSize ? static_cast<int>(i) : -1;
+
+            auto score = vertexScore(cachePosition[v], liveTriangles[v]);
+            auto delta = score - scores[v];
+            scores[v] = score;
+
+            for (std::uint32_t j = 0; j < liveTriangles[v]; j++) {
+                triangleScores[adjacency[offsets[v] + j]] += delta;
+            }
+        }
+
+        if (newCache.size() > CacheSize) {
+            newCache.resize(CacheSize);
+        }
+        cache.swap(newCache);
+
+        best = -1;
+        float bestScore = -1.0f;
+        for (auto v : cache) {
+            for (std::uint32_t j = 0; j < liveTriangles[v]; j++) {
+                auto t = adjacency[offsets[v] + j];
+                if (triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    // Keep any trailing indices that don't form a whole triangle
+    result.insert(result.end(), indices + triangleCount * 3, indices + indexCount);
+    return result;
+}
+
+void MeshOptimizer::optimizeOverdraw(
+    std::vector<std::uint16_t>& indices,
+    const char* vertices,
+    std::size_t vertexCount,
+    std::size_t vertexStride)
+{
+    const std::size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2) {
+        return;
+    }
+
+    // Left in their original order, as the positions of broken indices can't be read
+    auto outOfRange = [vertexCount](std::uint16_t index) { return index >= vertexCount; };
+    if (std::any_of(indices.begin(), indices.begin() + triangleCount * 3, outOfRange)) {
+        return;
+    }
+
+    // Split the cache-ordered sequence where the simulated cache starts over, so
+    // reordering whole clusters keeps most of the cache locality
+    std::vector<std::size_t> clusters;
+    {
+        std::vector<std::size_t> timestamps(vertexCount, 0);
+        std::size_t time = 17;
+        for (std::size_t t = 0; t < triangleCount; t++) {
+            int misses = 0;
+            for (int k = 0; k < 3; k++) {
+                auto v = indices[t * 3 + k];
+                if (time - timestamps[v] > 16) {
+                    timestamps[v] = time++;
+                    misses++;
+                }
+            }
+
+            if (t == 0 || misses == 3) {
+                clusters.push_back(t);
+            }
+        }
+    }
+
+    if (clusters.size() < 2) {
+        return;
+    }
+
+    std::array<double, 3> meshCenter{ 0.0, 0.0, 0.0 };
+    for (std::size_t v = 0; v < vertexCount; v++) {
+        auto p = readPosition(vertices, vertexStride, v);
+        for (int k = 0; k < 3; k++) {
+            meshCenter[k] += p[k];
+        }
+    }
+    for (auto& c : meshCenter) {
+        c /= static_cast<double>(vertexCount);
+    }
+
+    // Clusters facing away from the center are likely to occlude the rest
+    std::vector<std::pair<float, std::size_t>> order;
+    order.reserve(clusters.size());
+    for (std::size_t c = 0; c < clusters.size(); c++) {
+        auto begin = clusters[c];
+        auto end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+        std::array<double, 3> centroid{ 0.0, 0.0, 0.0 };
+        std::array<double, 3> normal{ 0.0, 0.0, 0.0 };
+        double area = 0.0;
+
+        for (auto t = begin; t < end; t++) {
+            auto p0 = readPosition(vertices, vertexStride, indices[t * 3]);
+            auto p1 = readPosition(vertices, vertexStride, indices[t * 3 + 1]);
+            auto p2 = readPosition(vertices, vertexStride, indices[t * 3 + 2]);
+
+            std::array<double, 3> e1{ p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            std::array<double, 3> e2{ p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            std::array<double, 3> n{
+                e1[1] * e2[2] - e1[2] * e2[1],
+                e1[2] * e2[0] - e1[0] * e2[2],
+                e1[0] * e2[1] - e1[1] * e2[0],
+            };
+
+            auto triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; k++) {
+                centroid[k] += (p0[k] + p1[k] + p2[k]) / 3.0 * triangleArea;
+                normal[k] += n[k];
+            }
+            area += triangleArea;
+        }
+
+        float sortKey = 0.0f;
+        auto normalLength =
+            std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (area > 0.0 && normalLength > 0.0) {
+            for (int k = 0; k < 3; k++) {
+                sortKey += static_cast<float>(
+                    (centroid[k] / area - meshCenter[k]) * normal[k] / normalLength);
+            }
+        }
+
+        order.emplace_back(sortKey, c);
+    }
+
+    std::stable_sort(order.begin(), order.end(), [](auto& a, auto& b) {
+        return a.first > b.first;
+    });
+
+    std::vector<std::uint16_t> sorted;
+    sorted.reserve(indices.size());
+    for (auto& [key, c] : order) {
+        auto begin = clusters[c];
+        auto end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+        sorted.insert(sorted.end(), indices.begin() + begin * 3, indices.begin() + end * 3);
+    }
+    sorted.insert(sorted.end(), indices.begin() + triangleCount * 3, indices.end());
+
+    auto before = computeACMR(indices.data(), indices.size(), vertexCount);
+    auto after = computeACMR(sorted.data(), sorted.size(), vertexCount);
+    if (after <= before * OverdrawThreshold) {
+        indices.swap(sorted);
+    }
+}
+
+std::vector<std::uint32_t> MeshOptimizer::optimizeVertexFetch(
+    std::vector<std::uint16_t>& indices,
+    std::size_t vertexCount)
+{
+    constexpr auto Unused = ~std::uint32_t(0);
+
+    std::vector<std::uint32_t> remap(vertexCount, Unused);
+    std::uint32_t next = 0;
+
+    for (auto& index : indices) {
+        if (index >= vertexCount) {
+            continue;
+        }
+
+        if (remap[index] == Unused) {
+            remap[index] = next++;
+        }
+        index = static_cast<std::uint16_t>(remap[index]);
+    }
+
+    // Unreferenced vertices go to the end so the vertex count doesn't change
+    for (auto& target : remap) {
+        if (target == Unused) {
+            target = next++;
+        }
+    }
+
+    return remap;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Reorders triangles for post-transform vertex cache locality and overdraw, and
+// vertices for fetch locality. Results are cached by mesh content.
+class MeshOptimizer
+{
+public:
+    struct Result
+    {
+        std::vector<std::uint16_t> indices;
+
+        // New vertex index for each original vertex
+        std::vector<std::uint32_t> remap;
+
+        float acmrBefore = 0.0f;
+        float acmrAfter = 0.0f;
+    };
+
+    static MeshOptimizer& instance();
+
+    MeshOptimizer(const MeshOptimizer&) = delete;
+    MeshOptimizer(MeshOptimizer&&) = delete;
+    MeshOptimizer& operator=(const MeshOptimizer&) = delete;
+    MeshOptimizer& operator=(MeshOptimizer&&) = delete;
+
+    bool isEnabled() const { return m_Enabled; }
+    void setEnabled(bool enabled) { m_Enabled = enabled; }
+
+    // Positions are read as three floats at the start of each vertex
+    std::shared_ptr<const Result> optimize(
+        const std::uint16_t* indices,
+        std::size_t indexCount,
+        const char* vertices,
+        std::size_t vertexCount,
+        std::size_t vertexStride);
+
+    // Average cache miss ratio for a FIFO cache of the given size
+    static float computeACMR(
+        const std::uint16_t* indices,
+        std::size_t indexCount,
+        std::size_t vertexCount,
+        std::size_t cacheSize = 16);
+
+private:
+    MeshOptimizer() = default;
+    ~MeshOptimizer() = default;
+
+    static std::vector<std::uint16_t> optimizeVertexCache(
+        const std::uint16_t* indices,
+        std::size_t indexCount,
+        std::size_t vertexCount);
+
+    static void optimizeOverdraw(
+        std::vector<std::uint16_t>& indices,
+        const char* vertices,
+        std::size_t vertexCount,
+        std::size_t vertexStride);
+
+    static std::vector<std::uint32_t> optimizeVertexFetch(
+        std::vector<std::uint16_t>& indices,
+        std::size_t vertexCount);
+
+    inline static constexpr std::size_t MaxCachedResults = 256;
+
+    bool m_Enabled = true;
+
+    std::mutex m_Mutex;
+    std::list<std::uint64_t> m_Recent;
+    std::unordered_map<std::uint64_t, std::shared_ptr<const Result>> m_Results;
+};
@@ -0,0 +1,303 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <queue>
+#include <unordered_map>
+
+namespace
+{
+using Position = std::array<float, 3>;
+
+// Symmetric 4x4 matrix summing squared distances to planes
+struct Quadric
+{
+    // a2 ab ac ad b2 bc bd c2 cd d2
+    std::array<double, 10> m{};
+
+    void addPlane(double a, double b, double c, double d, double weight)
+    {
+        m[0] += weight * a * a;
+        m[1] += weight * a * b;
+        m[2] += weight * a * c;
+        m[3] += weight * a * d;
+        m[4] += weight * b * b;
+        m[5] += weight * b * c;
+        m[6] += weight * b * d;
+        m[7] += weight * c * c;
+        m[8] += weight * c * d;
+        m[9] += weight * d * d;
+    }
+
+    Quadric& operator+=(const Quadric& other)
+    {
+        for (std::size_t i = 0; i < m.size(); i++) {
+            m[i] += other.m[i];
+        }
+        return *this;
+    }
+
+    double error(const Position& p) const
+    {
+        double x = p[0], y = p[1], z = p[2];
+        return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x +
+               m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y + m[7] * z * z +
+               2 * m[8] * z + m[9];
+    }
+};
+
+struct Collapse
+{
+    double cost;
+    std::uint32_t from;
+    std::uint32_t to;
+    std::uint32_t fromVersion;
+    std::uint32_t toVersion;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+Position cross(const Position& a, const Position& b)
+{
+    return { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+}
+
+Position subtract(const Position& a, const Position& b)
+{
+    return { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+}
+
+float dot(const Position& a, const Position& b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+std::uint64_t edgeKey(std::uint32_t a, std::uint32_t b)
+{
+    return (static_cast<std::uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+}
+}
+
+std::vector<std::uint16_t> MeshSimplifier::simplify(
+    const std::uint16_t* indices,
+    std::size_t indexCount,
+    const float* positions,
+    std::size_t vertexCount,
+    std::size_t targetIndexCount)
+{
+    auto position = [positions](std::uint32_t vertex) {
+        return Position{
+            positions[vertex * 3], positions[vertex * 3 + 1], positions[vertex * 3 + 2] };
+    };
+
+    // Vertices split for UV or normal seams share a position; collapses work on the
+    // welded mesh so the seams are seen as connected
+    std::vector<std::uint32_t> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+        return position(a) < position(b);
+    });
+
+    std::vector<std::uint32_t> weld(vertexCount);
+    std::vector<bool> locked(vertexCount, false);
+    for (std::size_t i = 0; i < vertexCount;) {
+        auto end = i + 1;
+        while (end < vertexCount && position(order[end]) == position(order[i])) {
+            end++;
+        }
+
+        for (auto j = i; j < end; j++) {
+            weld[order[j]] = order[i];
+        }
+
+        locked[order[i]] = end - i > 1;
+        i = end;
+    }
+
+    // Triangles keep their original indices; corners are compared after welding
+    std::vector<std::array<std::uint32_t, 3>> triangles;
+    triangles.reserve(indexCount / 3);
+    for (std::size_t i = 0; i + 2 < indexCount; i += 3) {
+        std::array<std::uint32_t, 3> triangle{ indices[i], indices[i + 1], indices[i + 2] };
+        if (triangle[0] >= vertexCount || triangle[1] >= vertexCount ||
+            triangle[2] >= vertexCount) {
+            continue;
+        }
+
+        auto a = weld[triangle[0]], b = weld[triangle[1]], c = weld[triangle[2]];
+        if (a != b && b != c && a != c) {
+            triangles.push_back(triangle);
+        }
+    }
+
+    std::vector<bool> live(triangles.size(), true);
+    std::size_t liveCount = triangles.size();
+
+    std::vector<Quadric> quadrics(vertexCount);
+    std::vector<std::vector<std::uint32_t>> vertexTriangles(vertexCount);
+    std::unordered_map<std::uint64_t, int> edgeUses;
+
+    for (std::uint32_t t = 0; t < triangles.size(); t++) {
+        std::array<std::uint32_t, 3> corners{
+            weld[triangles[t][0]], weld[triangles[t][1]], weld[triangles[t][2]] };
+
+        auto p0 = position(corners[0]);
+        auto normal =
+            cross(subtract(position(corners[1]), p0), subtract(position(corners[2]), p0));
+        double length = std::sqrt(static_cast<double>(dot(normal, normal)));
+
+        // Area weighted, so large faces resist being moved more than slivers
+        if (length > 0.0) {
+            double a = normal[0] / length, b = normal[1] / length, c = normal[2] / length;
+            double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+
+            Quadric quadric;
+            quadric.addPlane(a, b, c, d, length * 0.5);
+            for (auto corner : corners) {
+                quadrics[corner] += quadric;
+            }
+        }
+
+        for (int i = 0; i < 3; i++) {
+            vertexTriangles[corners[i]].push_back(t);
+            edgeUses[edgeKey(corners[i], corners[(i + 1) % 3])]++;
+        }
+    }
+
+    // Moving a border vertex would open a hole
+    for (auto& [key, uses] : edgeUses) {
+        if (uses != 2) {
+            locked[key >> 32] = true;
+            locked[key & 0xFFFFFFFF] = true;
+        }
+    }
+
+    std::vector<std::uint32_t> versions(vertexCount, 0);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+
+    auto pushEdge = [&](std::uint32_t a, std::uint32_t b) {
+        auto combined = quadrics[a];
+        combined += quadrics[b];
+
+        if (!locked[a]) {
+            queue.push({ combined.error(position(b)), a, b, versions[a], versions[b] });
+        }
+        if (!locked[b]) {
+            queue.push({ combined.error(position(a)), b, a, versions[b], versions[a] });
+        }
+    };
+
+    for (auto& [key, uses] : edgeUses) {
+        pushEdge(static_cast<std::uint32_t>(key >> 32), static_cast<std::uint32_t>(key));
+    }
+
+    auto corner = [&](std::uint32_t t, int i) { return weld[triangles[t][i]]; };
+
+    while (liveCount * 3 > targetIndexCount && !queue.empty()) {
+        auto collapse = queue.top();
+        queue.pop();
+
+        auto from = collapse.from;
+        auto to = collapse.to;
+        if (versions[from] != collapse.fromVersion || versions[to] != collapse.toVersion) {
+            continue;
+        }
+
+        // Reject collapses that flip a remaining triangle, and find the original index
+        // the shared triangles use for the target, which matters at seams
+        bool valid = true;
+        std::uint32_t target = to;
+        auto toPosition = position(to);
+
+        for (auto t : vertexTriangles[from]) {
+            if (!live[t]) {
+                continue;
+            }
+
+            int fromCorner = -1;
+            int toCorner = -1;
+            for (int i = 0; i < 3; i++) {
+                fromCorner = corner(t, i) == from ? i : fromCorner;
+                toCorner = corner(t, i) == to ? i : toCorner;
+            }
+
+            if (toCorner >= 0) {
+                target = triangles[t][toCorner];
+                continue;
+            }
+
+            auto p1 = position(corner(t, (fromCorner + 1) % 3));
+            auto p2 = position(corner(t, (fromCorner + 2) % 3));
+            auto before = cross(subtract(p1, position(from)), subtract(p2, position(from)));
+            auto after = cross(subtract(p1, toPosition), subtract(p2, toPosition));
+
+            if (dot(before, after) <= 0.0f) {
+                valid = false;
+                break;
+            }
+        }
+
+        if (!valid) {
+            continue;
+        }
+
+        for (auto t : vertexTriangles[from]) {
+            if (!live[t]) {
+                continue;
+            }
+
+            bool shared = false;
+            for (int i = 0; i < 3; i++) {
+                shared = shared || corner(t, i) == to;
+            }
+
+            if (shared) {
+                live[t] = false;
+                liveCount--;
+                continue;
+            }
+
+            for (auto& index : triangles[t]) {
+                if (weld[index] == from) {
+                    index = target;
+                }
+            }
+            vertexTriangles[to].push_back(t);
+        }
+
+        vertexTriangles[from] = {};
+        quadrics[to] += quadrics[from];
+        versions[from]++;
+        versions[to]++;
+
+        // Drop removed triangles and requeue the edges around the merged vertex
+        auto& adjacent = vertexTriangles[to];
+        adjacent.erase(
+            std::remove_if(adjacent.begin(), adjacent.end(), [&](std::uint32_t t) {
+                return !live[t];
+            }),
+            adjacent.end());
+
+        for (auto t : adjacent) {
+            for (int i = 0; i < 3; i++) {
+                if (corner(t, i) != to) {
+                    pushEdge(to, corner(t, i));
+                }
+            }
+        }
+    }
+
+    std::vector<std::uint16_t> result;
+    result.reserve(liveCount * 3);
+    for (std::size_t t = 0; t < triangles.size(); t++) {
+        if (live[t]) {
+            for (auto index : triangles[t]) {
+                result.push_back(static_cast<std::uint16_t>(index));
+            }
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Reduces triangle counts with quadric error edge collapses (Garland and Heckbert).
+// Vertices are only ever collapsed onto other vertices of the mesh, so the reduced
+// indices draw from the original vertex buffer. Borders and UV or normal seams are
+// kept in place to avoid cracks.
+class MeshSimplifier
+{
+public:
+    // Shapes with more triangles get a reduced version of about this many for drawing
+    // while the camera moves; 0 disables simplification
+    static int triangleBudget() { return TriangleBudget; }
+    static void setTriangleBudget(int triangles) { TriangleBudget = triangles; }
+
+    // Positions are tightly packed xyz floats. Collapses stop once at most
+    // targetIndexCount indices remain, or earlier if only collapses that would move a
+    // border or seam or fold a triangle over are left.
+    static std::vector<std::uint16_t> simplify(
+        const std::uint16_t* indices,
+        std::size_t indexCount,
+        const float* positions,
+        std::size_t vertexCount,
+        std::size_t targetIndexCount);
+
+private:
+    inline static int TriangleBudget = 50000;
+};
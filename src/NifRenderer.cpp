@@ -0,0 +1,486 @@
+#include "NifRenderer.h"
+#include "MeshSimplifier.h"
+#include "NifExtensions.h"
+#include "ShaderManager.h"
+#include "StaticBatcher.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_2_1>
+#include <QOpenGLVersionFunctionsFactory>
+
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QThreadPool>
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+NifRenderer::NifRenderer(
+    std::shared_ptr<nifly::NifFile> nifFile,
+    std::shared_ptr<PathResolver> resolver)
+    : m_NifFile{ nifFile },
+      m_TextureManager{ std::make_unique<TextureManager>(std::move(resolver)) }
+{}
+
+NifRenderer::NifRenderer(
+    std::shared_ptr<CachedMesh> cachedMesh,
+    std::shared_ptr<PathResolver> resolver)
+    : m_CachedMesh{ std::move(cachedMesh) },
+      m_Cached{ true },
+      m_TextureManager{ std::make_unique<TextureManager>(std::move(resolver)) }
+{}
+
+void NifRenderer::setSourceFile(const QString& fileName)
+{
+    m_SourceFile = fileName;
+
+    auto suffix = QFileInfo(fileName).suffix();
+    m_BatchShapes = suffix.compare("bto", Qt::CaseInsensitive) == 0 ||
+                    suffix.compare("btr", Qt::CaseInsensitive) == 0;
+}
+
+void NifRenderer::setTraceSummary(std::shared_ptr<TraceSummary> summary)
+{
+    m_TraceSummary = summary;
+    m_TextureManager->setTraceSummary(std::move(summary));
+}
+
+void NifRenderer::createResources()
+{
+    TraceSummary::Bind bind{ m_TraceSummary.get() };
+    TraceScope scope{ "Create resources" };
+
+    auto layout = VertexLayout::forContext(QOpenGLContext::currentContext());
+    m_GeometryBuffer = std::make_unique<GeometryBuffer>(layout);
+
+    // A NIF released after an earlier upload comes back from the mesh cache if it can,
+    // and is parsed again otherwise
+    if (!m_CachedMesh && !m_NifFile) {
+        m_CachedMesh = MeshCache::instance().load(m_SourceFile);
+    }
+
+    // Cached vertices only suit contexts with the texture coordinate format they were
+    // packed for, otherwise the NIF is parsed after all
+    if (m_CachedMesh && m_CachedMesh->halfTexCoord() != layout.halfTexCoord) {
+        m_CachedMesh.reset();
+    }
+
+    if (m_CachedMesh) {
+        createCachedShapes();
+    }
+    else {
+        createShapes();
+    }
+
+    // The mesh cache keeps the shapes where the NIF has them
+    if (!m_Origin.isNull()) {
+        for (auto& shape : m_GLShapes) {
+            QMatrix4x4 translation;
+            translation.translate(m_Origin);
+            shape.modelMatrix = translation * shape.modelMatrix;
+            shape.boundsCenter += m_Origin;
+        }
+    }
+
+    for (auto& shape : m_GLShapes) {
+        shape.createVertexArray(m_GeometryBuffer.get());
+    }
+
+    m_RenderQueue.build(m_GLShapes);
+    m_VisibilityRevision = 0;
+
+    auto f = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_2_1>(
+        QOpenGLContext::currentContext());
+
+    f->glEnable(GL_DEPTH_TEST);
+    f->glDepthFunc(GL_LEQUAL);
+    f->glClearColor(0.18, 0.18, 0.18, 1.0);
+
+    ShaderManager::instance().attach();
+    m_HasResources = true;
+}
+
+std::shared_ptr<nifly::NifFile> NifRenderer::nifFile()
+{
+    if (!m_NifFile && !m_SourceFile.isEmpty()) {
+        TraceScope scope{ "Parse NIF" };
+        m_NifFile = std::make_shared<nifly::NifFile>(
+            std::filesystem::path(m_SourceFile.toStdWString()));
+
+        if (!m_NifFile->IsValid()) {
+            qWarning(qUtf8Printable(QObject::tr("Failed to load file: %1").arg(m_SourceFile)));
+            m_NifFile.reset();
+        }
+    }
+
+    return m_NifFile;
+}
+
+void NifRenderer::createShapes()
+{
+    if (!nifFile()) {
+        return;
+    }
+
+    m_SceneGraph = std::make_unique<SceneGraph>(m_NifFile.get());
+
+    auto shapes = m_NifFile->GetShapes();
+    for (auto& shape : shapes) {
+        if (shape->flags & TriShape::Hidden) {
+            continue;
+        }
+
+        m_GLShapes.emplace_back(
+            m_NifFile.get(),
+            shape,
+            *m_SceneGraph,
+            m_GeometryBuffer.get());
+    }
+
+    m_GeometryBuffer->packPending();
+
+    // Cached meshes are stored batched
+    if (m_BatchShapes) {
+        StaticBatcher::batch(m_GLShapes, *m_GeometryBuffer);
+    }
+
+    simplifyShapes(
+        m_GeometryBuffer->stagedVertices().data(),
+        m_GeometryBuffer->stagedIndices().data());
+
+    if (!m_Cached && !m_SourceFile.isEmpty()) {
+        MeshCache::instance().store(
+            m_SourceFile,
+            *m_GeometryBuffer,
+            m_GLShapes,
+            CachedMesh::Stats::count(m_NifFile.get()),
+            [weak = std::weak_ptr(m_Stored)]() {
+                auto stored = weak.lock();
+                if (!stored) {
+                    return;
+                }
+
+                stored->stored = true;
+                QMetaObject::invokeMethod(
+                    qApp,
+                    [weak]() {
+                        if (auto stored = weak.lock(); stored && stored->onReady) {
+                            stored->onReady();
+                        }
+                    },
+                    Qt::QueuedConnection);
+            });
+        m_Cached = true;
+    }
+
+    m_GeometryBuffer->upload();
+
+    // Blocks, strings and geometry arrays of large LOD files take tens of megabytes
+    // that are no longer needed; without a source file it couldn't be read again
+    if (!m_SourceFile.isEmpty()) {
+        m_SceneGraph.reset();
+        m_NifFile.reset();
+    }
+}
+
+void NifRenderer::takeCachedMesh()
+{
+    if (m_CachedMesh || !m_Stored->stored.exchange(false)) {
+        return;
+    }
+
+    // The cached copy is mapped, so it stays readable even if the cache is trimmed, and
+    // rebuilding the resources doesn't need to parse the NIF again
+    m_CachedMesh = MeshCache::instance().load(m_SourceFile);
+}
+
+void NifRenderer::createCachedShapes()
+{
+    m_GLShapes = m_CachedMesh->shapes();
+    simplifyShapes(m_CachedMesh->vertices(), m_CachedMesh->indices());
+
+    m_GeometryBuffer->upload(
+        m_CachedMesh->vertices(),
+        m_CachedMesh->vertexSize(),
+        m_CachedMesh->indices(),
+        m_CachedMesh->indexCount());
+}
+
+void NifRenderer::simplifyShapes(const char* vertices, const std::uint16_t* indices)
+{
+    m_Simplified = std::make_shared<SimplifiedMeshes>();
+
+    auto budget = MeshSimplifier::triangleBudget();
+    if (budget <= 0) {
+        return;
+    }
+
+    auto& layout = m_GeometryBuffer->layout();
+    for (std::size_t i = 0; i < m_GLShapes.size(); i++) {
+        auto& range = m_GLShapes[i].geometry;
+        if (range.indexCount / 3 <= static_cast<std::size_t>(budget)) {
+            continue;
+        }
+
+        // The workers get their own copies, as the staged data is released on upload
+        std::vector<float> positions(range.vertexCount * 3);
+        for (std::size_t v = 0; v < range.vertexCount; v++) {
+            auto vertex = vertices + (range.firstVertex + v) * layout.stride;
+            std::memcpy(&positions[v * 3], vertex + layout.position, 3 * sizeof(float));
+        }
+
+        std::vector<std::uint16_t> shapeIndices(
+            indices + range.firstIndex, indices + range.firstIndex + range.indexCount);
+
+        QThreadPool::globalInstance()->start(
+            [results = m_Simplified, i, budget, positions = std::move(positions),
+             shapeIndices = std::move(shapeIndices)]() {
+                TraceScope scope{ "Simplify mesh" };
+
+                auto simplified = MeshSimplifier::simplify(
+                    shapeIndices.data(),
+                    shapeIndices.size(),
+                    positions.data(),
+                    positions.size() / 3,
+                    static_cast<std::size_t>(budget) * 3);
+
+                std::lock_guard lock{ results->mutex };
+                results->meshes.emplace_back(i, std::move(simplified));
+            });
+    }
+}
+
+void NifRenderer::uploadSimplified()
+{
+    if (!m_Simplified) {
+        return;
+    }
+
+    std::vector<std::pair<std::size_t, std::vector<std::uint16_t>>> meshes;
+    {
+        std::lock_guard lock{ m_Simplified->mutex };
+        meshes.swap(m_Simplified->meshes);
+    }
+
+    for (auto& [index, indices] : meshes) {
+        auto& shape = m_GLShapes[index];
+
+        // Meshes made of borders and seams can't be reduced much
+        auto elements = static_cast<std::size_t>(shape.elements);
+        if (!indices.empty() && indices.size() < elements / 2) {
+            shape.createLodVertexArray(m_GeometryBuffer.get(), indices);
+        }
+    }
+}
+
+void NifRenderer::destroy()
+{
+    for (auto& shape : m_GLShapes) {
+        shape.destroy();
+    }
+    m_RenderQueue.clear();
+    m_GLShapes.clear();
+
+    if (m_GeometryBuffer) {
+        m_GeometryBuffer->destroy();
+        m_GeometryBuffer.reset();
+    }
+
+    m_SceneGraph.reset();
+
+    // Simplifications still running finish into the old results and are dropped
+    m_Simplified.reset();
+
+    m_TextureManager->cleanup();
+
+    if (m_HasResources) {
+        ShaderManager::instance().detach();
+        m_HasResources = false;
+    }
+}
+
+void NifRenderer::render()
+{
+    if (!m_HasResources) {
+        createResources();
+    }
+
+    TraceSummary::Bind bind{ m_TraceSummary.get() };
+
+    takeCachedMesh();
+    uploadSimplified();
+
+    if (m_TextureManager->uploadPending()) {
+        for (auto& shape : m_GLShapes) {
+            if (shape.texturesRequested) {
+                shape.resolveTextures(m_TextureManager.get());
+            }
+        }
+        m_RenderQueue.build(m_GLShapes);
+
+        // No shape references the textures that higher mip levels replaced anymore
+        m_TextureManager->releaseSuperseded();
+    }
+
+    if (m_VisibilityRevision != m_CameraRevision) {
+        updateVisibility();
+    }
+
+    auto f = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_2_1>(
+        QOpenGLContext::currentContext());
+    if (m_ClearFramebuffer) {
+        f->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    m_GLState.reset(f);
+    GeometryBuffer::setConstantAttributes(QOpenGLContext::currentContext());
+
+    auto& shaderManager = ShaderManager::instance();
+
+    m_DrawCount = 0;
+    m_CulledCount = 0;
+    for (auto& item : m_RenderQueue.items()) {
+        auto& shape = *item.shape;
+
+        if (!shape.visible) {
+            m_CulledCount++;
+            continue;
+        }
+
+        auto program = shaderManager.getProgram(shape.shaderType);
+        if (program && program->isLinked() && m_GLState.useProgram(program)) {
+            // Reduced detail keeps orbiting smooth on slow GL implementations
+            bool reduced = m_Interacting && shape.lodVertexArray;
+            auto binder = QOpenGLVertexArrayObject::Binder(
+                reduced ? shape.lodVertexArray : shape.vertexArray);
+
+            auto& uniforms = shaderManager.uniforms(shape.shaderType);
+            auto& state = shaderManager.programState(shape.shaderType);
+            bool sameShape = state.shape == &shape;
+
+            if (shape.cameraRevision != m_CameraRevision) {
+                shape.updateMatrices(m_ViewMatrix, m_ProjectionMatrix);
+                shape.cameraRevision = m_CameraRevision;
+            }
+
+            if (!sameShape || state.cameraRevision != m_CameraRevision) {
+                shape.uploadMatrices(program, uniforms, m_ViewMatrix);
+                state.cameraRevision = m_CameraRevision;
+            }
+
+            if (!sameShape || state.materialRevision != shape.materialRevision) {
+                shape.uploadMaterial(program, uniforms);
+                state.materialRevision = shape.materialRevision;
+            }
+
+            state.shape = &shape;
+            m_GLState.applyShape(shape);
+
+            if (reduced) {
+                f->glDrawElements(
+                    GL_TRIANGLES, shape.lodElements, GL_UNSIGNED_SHORT, nullptr);
+                m_DrawCount++;
+            }
+            else if (shape.elements > 0) {
+                f->glDrawElements(
+                    GL_TRIANGLES, shape.elements, GL_UNSIGNED_SHORT, shape.indexOffset());
+                m_DrawCount++;
+            }
+        }
+    }
+
+    m_GLState.finish();
+}
+
+void NifRenderer::updateVisibility()
+{
+    auto frustum = Frustum(m_ProjectionMatrix * m_ViewMatrix);
+
+    bool requested = false;
+    for (auto& shape : m_GLShapes) {
+        shape.visible = shape.boundsRadius < 0.0f ||
+                        frustum.intersectsSphere(shape.boundsCenter, shape.boundsRadius);
+
+        if (!shape.visible) {
+            continue;
+        }
+
+        auto size = TextureManager::quantizeSize(textureSize(shape));
+        if (!shape.texturesRequested || !TextureManager::coversSize(shape.textureSize, size)) {
+            shape.textureSize = size;
+            shape.resolveTextures(m_TextureManager.get());
+            shape.texturesRequested = true;
+            requested = true;
+        }
+    }
+
+    // Texture sets are part of the sort key
+    if (requested) {
+        m_RenderQueue.build(m_GLShapes);
+    }
+
+    m_VisibilityRevision = m_CameraRevision;
+}
+
+int NifRenderer::textureSize(const OpenGLShape& shape) const
+{
+    if (shape.boundsRadius < 0.0f || m_ViewportHeight <= 0) {
+        return 0;
+    }
+
+    // Once the camera is inside the bounds, any part of the texture can fill the view
+    float distance = -m_ViewMatrix.map(shape.boundsCenter).z();
+    if (distance <= shape.boundsRadius) {
+        return 0;
+    }
+
+    float tanHalfFov = std::tan(qDegreesToRadians(FieldOfView) * 0.5f);
+    float diameter = shape.boundsRadius / (distance * tanHalfFov) * m_ViewportHeight;
+
+    // Tiled textures repeat across the shape, so each repeat gets fewer pixels
+    float tiling = qMax(1.0f, qMax(std::abs(shape.uvScale.x()), std::abs(shape.uvScale.y())));
+    return static_cast<int>(std::ceil(diameter * tiling));
+}
+
+void NifRenderer::setViewport(int width, int height)
+{
+    QMatrix4x4 m;
+    m.perspective(FieldOfView, static_cast<float>(width) / height, m_NearPlane, m_FarPlane);
+
+    m_ViewportHeight = height;
+
+    m_ProjectionMatrix = m;
+    m_CameraRevision = OpenGLShape::nextRevision();
+}
+
+void NifRenderer::setCamera(Camera* camera)
+{
+    QMatrix4x4 m;
+    m.translate(0.0f, 0.0f, -camera->distance());
+    m.rotate(camera->pitch(), 1.0f, 0.0f, 0.0f);
+    m.rotate(camera->yaw(), 0.0f, 1.0f, 0.0f);
+    m.translate(-camera->lookAt());
+    m *= QMatrix4x4{
+        -1, 0, 0, 0,
+         0, 0, 1, 0,
+         0, 1, 0, 0,
+         0, 0, 0, 1,
+    };
+    m_ViewMatrix = m;
+    m_CameraRevision = OpenGLShape::nextRevision();
+}
+
+void NifRenderer::frameCamera(Camera* camera) const
+{
+    float largestRadius = 0.0f;
+    for (auto& shape : m_GLShapes) {
+        if (shape.boundsRadius > largestRadius) {
+            largestRadius = shape.boundsRadius;
+
+            auto& center = shape.boundsCenter;
+            camera->setDistance(shape.boundsRadius * 2.4f);
+            camera->setLookAt({ -center.x(), center.z(), center.y() });
+        }
+    }
+}
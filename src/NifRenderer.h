@@ -0,0 +1,180 @@
+#pragma once
+
+#include "Camera.h"
+#include "Frustum.h"
+#include "GeometryBuffer.h"
+#include "MeshCache.h"
+#include "OpenGLShape.h"
+#include "PathResolver.h"
+#include "RenderQueue.h"
+#include "SceneGraph.h"
+#include "SceneRenderer.h"
+#include "TextureManager.h"
+#include "Trace.h"
+
+#include <NifFile.hpp>
+
+#include <QMatrix4x4>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Draws a NIF into whatever framebuffer is bound on the current context. Shared by
+// the preview widget and offscreen renderers.
+class NifRenderer : public SceneRenderer
+{
+public:
+    NifRenderer(
+        std::shared_ptr<nifly::NifFile> nifFile,
+        std::shared_ptr<PathResolver> resolver);
+
+    // Draws meshes read from the mesh cache without the NIF
+    NifRenderer(
+        std::shared_ptr<CachedMesh> cachedMesh,
+        std::shared_ptr<PathResolver> resolver);
+
+    ~NifRenderer() override = default;
+    NifRenderer(const NifRenderer&) = delete;
+    NifRenderer(NifRenderer&&) = delete;
+    NifRenderer& operator=(const NifRenderer&) = delete;
+    NifRenderer& operator=(NifRenderer&&) = delete;
+
+    // Once its meshes are uploaded, a NIF with a source file is released, as the
+    // shapes keep everything drawing needs; this parses it again if the resources are
+    // rebuilt without a cached copy
+    std::shared_ptr<nifly::NifFile> nifFile();
+
+    TextureManager* textureManager() const { return m_TextureManager.get(); }
+
+    // Built with the resources from a NIF, for anything that needs global transforms
+    // while they are created; null when drawing cached meshes
+    const SceneGraph* sceneGraph() const { return m_SceneGraph.get(); }
+
+    // Meshes built from the NIF are written to the mesh cache under the file it was
+    // loaded from, which is also read again if cached meshes can't be used. Shapes of
+    // object and terrain LOD files are batched by material.
+    void setSourceFile(const QString& fileName) override;
+
+    // Loading work done by the renderer and its texture manager is timed in the summary
+    void setTraceSummary(std::shared_ptr<TraceSummary> summary) override;
+
+    void setReadyCallback(std::function<void()> callback) override
+    {
+        m_Stored->onReady = callback;
+        m_TextureManager->setReadyCallback(std::move(callback));
+    }
+
+    // Moves the whole NIF, for tiles placed in a worldspace; applied when the
+    // resources are created
+    void setOrigin(const QVector3D& origin) { m_Origin = origin; }
+
+    // Renderers drawing into a frame shared with others leave clearing to its owner
+    void setClearFramebuffer(bool clear) { m_ClearFramebuffer = clear; }
+
+    // Near and far planes used by the next setViewport
+    void setDepthRange(float nearPlane, float farPlane)
+    {
+        m_NearPlane = nearPlane;
+        m_FarPlane = farPlane;
+    }
+
+    // GPU resources are created from the NIF again after destroy; both require the
+    // context they are used with to be current
+    bool hasResources() const override { return m_HasResources; }
+    void createResources() override;
+    void destroy() override;
+
+    // Uploads decoded textures and draws every shape in the view frustum
+    void render() override;
+
+    // Shapes over the triangle budget are simplified in the background after the
+    // resources are created; while interacting, their reduced versions are drawn
+    void setInteracting(bool interacting) override { m_Interacting = interacting; }
+
+    // Culls shapes against the current camera and requests the textures of shapes
+    // that became visible for the first time, or now cover more of the screen than
+    // their textures were loaded for; render does this when the camera moved
+    void updateVisibility();
+
+    void setViewport(int width, int height) override;
+    void setCamera(Camera* camera) override;
+
+    bool hasPendingTextures() const override { return m_TextureManager->hasPending(); }
+    bool isUploading() const override { return m_TextureManager->isUploading(); }
+
+    GLState::Stats stateStats() const override { return m_GLState.stats(); }
+    int drawCount() const override { return m_DrawCount; }
+    int culledCount() const override { return m_CulledCount; }
+
+    // Centers the camera on the largest shape; requires the resources to be created
+    void frameCamera(Camera* camera) const override;
+
+private:
+    inline static constexpr float FieldOfView = 40.0f;
+
+    // Texture size that covers the shape's projected bounds, 0 for full resolution
+    int textureSize(const OpenGLShape& shape) const;
+
+    struct SimplifiedMeshes
+    {
+        std::mutex mutex;
+        std::vector<std::pair<std::size_t, std::vector<std::uint16_t>>> meshes;
+    };
+
+    void createShapes();
+    void createCachedShapes();
+
+    // Keeps the cached copy once the mesh cache has written it, for rebuilds
+    void takeCachedMesh();
+
+    // Requires the shapes' packed vertices and indices
+    void simplifyShapes(const char* vertices, const std::uint16_t* indices);
+    void uploadSimplified();
+
+    std::shared_ptr<nifly::NifFile> m_NifFile;
+    std::shared_ptr<CachedMesh> m_CachedMesh;
+    QString m_SourceFile;
+
+    // Set by the writing thread once the meshes stored by this renderer can be read
+    // back, which then requests a frame through the ready callback
+    struct StoredMesh
+    {
+        std::atomic<bool> stored = false;
+        std::function<void()> onReady;
+    };
+
+    // Whether the meshes are in the mesh cache already
+    bool m_Cached = false;
+    std::shared_ptr<StoredMesh> m_Stored = std::make_shared<StoredMesh>();
+    bool m_BatchShapes = false;
+    std::unique_ptr<TextureManager> m_TextureManager;
+    std::shared_ptr<TraceSummary> m_TraceSummary;
+
+    std::unique_ptr<SceneGraph> m_SceneGraph;
+    std::unique_ptr<GeometryBuffer> m_GeometryBuffer;
+    std::vector<OpenGLShape> m_GLShapes;
+    RenderQueue m_RenderQueue;
+    GLState m_GLState;
+
+    QVector3D m_Origin;
+    bool m_ClearFramebuffer = true;
+    float m_NearPlane = 0.1f;
+    float m_FarPlane = 10000.0f;
+
+    QMatrix4x4 m_ViewMatrix;
+    QMatrix4x4 m_ProjectionMatrix;
+    int m_ViewportHeight = 0;
+    std::uint64_t m_CameraRevision = 0;
+    std::uint64_t m_VisibilityRevision = 0;
+
+    std::shared_ptr<SimplifiedMeshes> m_Simplified;
+    bool m_Interacting = false;
+
+    bool m_HasResources = false;
+    int m_DrawCount = 0;
+    int m_CulledCount = 0;
+};
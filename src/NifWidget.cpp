@@ -1,6 +1,8 @@
 #include "NifWidget.h"
-#include "NifExtensions.h"
+#include "OrganizerResolver.h"
+#include "WorldRenderer.h"
 
+#include <QCoreApplication>
 #include <QMouseEvent>
 #include <QWheelEvent>
 #include <QOpenGLContext>
@@ -8,28 +10,95 @@
 #include <QOpenGLVersionFunctionsFactory>
 using OpenGLFunctions = QOpenGLFunctions_2_1;
 
+// Exported by QtGui but only declared in its private headers. QOpenGLWidget shares
+// with this context instead of one of its window, which the plugin can't otherwise
+// arrange once the application exists.
+Q_GUI_EXPORT void qt_gl_set_global_share_context(QOpenGLContext* context);
+
+namespace
+{
+QSurfaceFormat surfaceFormat()
+{
+    QSurfaceFormat format;
+    format.setVersion(2, 1);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    return format;
+}
+}
+
 NifWidget::NifWidget(
     std::shared_ptr<nifly::NifFile> nifFile,
     MOBase::IOrganizer* moInfo,
     bool debugContext,
     QWidget* parent,
     Qt::WindowFlags f)
+    : NifWidget(
+          std::make_unique<NifRenderer>(
+              nifFile, std::make_shared<OrganizerResolver>(moInfo)),
+          &SharedCamera,
+          debugContext,
+          parent,
+          f)
+{}
+
+NifWidget::NifWidget(
+    std::shared_ptr<CachedMesh> cachedMesh,
+    MOBase::IOrganizer* moInfo,
+    bool debugContext,
+    QWidget* parent,
+    Qt::WindowFlags f)
+    : NifWidget(
+          std::make_unique<NifRenderer>(
+              std::move(cachedMesh), std::make_shared<OrganizerResolver>(moInfo)),
+          &SharedCamera,
+          debugContext,
+          parent,
+          f)
+{}
+
+NifWidget::NifWidget(
+    std::shared_ptr<LodGrid> grid,
+    MOBase::IOrganizer* moInfo,
+    bool debugContext,
+    QWidget* parent,
+    Qt::WindowFlags f)
+    : NifWidget(
+          std::make_unique<WorldRenderer>(
+              std::move(grid), std::make_shared<OrganizerResolver>(moInfo)),
+          nullptr,
+          debugContext,
+          parent,
+          f)
+{}
+
+NifWidget::NifWidget(
+    std::unique_ptr<SceneRenderer> renderer,
+    QWeakPointer<Camera>* sharedCamera,
+    bool debugContext,
+    QWidget* parent,
+    Qt::WindowFlags f)
     : QOpenGLWidget(parent, f),
-      m_NifFile{ nifFile },
-      m_MOInfo{ moInfo },
-      m_TextureManager{ std::make_unique<TextureManager>(moInfo) },
-      m_ShaderManager{ std::make_unique<ShaderManager>(moInfo) }
+      m_Renderer{ std::move(renderer) },
+      m_SharedCamera{ sharedCamera }
 {
-    QSurfaceFormat format;
-    format.setVersion(2, 1);
-    format.setProfile(QSurfaceFormat::CoreProfile);
-
+    auto format = surfaceFormat();
     if (debugContext) {
         format.setOption(QSurfaceFormat::DebugContext);
         m_Logger = new QOpenGLDebugLogger(this);
     }
 
     setFormat(format);
+
+    m_Renderer->setReadyCallback([this]() { update(); });
+
+    m_ReleaseTimer.setSingleShot(true);
+    connect(&m_ReleaseTimer, &QTimer::timeout, this, &NifWidget::releaseResources);
+
+    m_IdleTimer.setSingleShot(true);
+    connect(&m_IdleTimer, &QTimer::timeout, this, [this]() {
+        m_Renderer->setInteracting(false);
+        update();
+    });
 }
 
 NifWidget::~NifWidget()
@@ -37,6 +106,35 @@ NifWidget::~NifWidget()
     cleanup();
 }
 
+void NifWidget::shareContexts()
+{
+    if (QOpenGLContext::globalShareContext()) {
+        return;
+    }
+
+    // Lives as long as the application, like the one Qt creates for the attribute
+    auto context = new QOpenGLContext(qApp);
+    context->setFormat(surfaceFormat());
+    if (!context->create()) {
+        qWarning(qUtf8Printable(tr("Failed to create shared OpenGL context")));
+        delete context;
+        return;
+    }
+
+    qt_gl_set_global_share_context(context);
+}
+
+void NifWidget::setSourceFile(const QString& fileName)
+{
+    m_Renderer->setSourceFile(fileName);
+}
+
+void NifWidget::setTraceSummary(std::shared_ptr<TraceSummary> summary)
+{
+    m_TraceSummary = summary;
+    m_Renderer->setTraceSummary(std::move(summary));
+}
+
 void NifWidget::mousePressEvent(QMouseEvent* event)
 {
     m_MousePos = event->globalPos();
@@ -80,6 +178,27 @@ void NifWidget::wheelEvent(QWheelEvent* event)
     m_Camera->zoomFactor(1.0f - (event->angleDelta().y() / 120.0f * 0.38f));
 }
 
+void NifWidget::showEvent(QShowEvent* event)
+{
+    QOpenGLWidget::showEvent(event);
+
+    m_ReleaseTimer.stop();
+
+    if (!m_Renderer->hasResources() || m_NeedsRepaint) {
+        m_NeedsRepaint = false;
+        update();
+    }
+}
+
+void NifWidget::hideEvent(QHideEvent* event)
+{
+    QOpenGLWidget::hideEvent(event);
+
+    if (ReleaseDelay > 0 && m_Renderer->hasResources()) {
+        m_ReleaseTimer.start(ReleaseDelay * 1000);
+    }
+}
+
 void NifWidget::initializeGL()
 {
     if (m_Logger) {
@@ -94,122 +213,100 @@ void NifWidget::initializeGL()
             });
     }
 
-    auto shapes = m_NifFile->GetShapes();
-    for (auto& shape : shapes) {
-        if (shape->flags & TriShape::Hidden) {
-            continue;
-        }
+    m_Renderer->createResources();
 
-        m_GLShapes.emplace_back(m_NifFile.get(), shape, m_TextureManager.get());
+    if (m_SharedCamera) {
+        m_Camera = *m_SharedCamera;
     }
 
-    m_Camera = SharedCamera;
     if (m_Camera.isNull()) {
         m_Camera = { new Camera(), &Camera::deleteLater };
-        SharedCamera = m_Camera;
-
-        float largestRadius = 0.0f;
-        for (auto& shape : shapes) {
-            auto bounds = GetBoundingSphere(m_NifFile.get(), shape);
-
-            if (bounds.radius > largestRadius) {
-                largestRadius = bounds.radius;
-
-                m_Camera->setDistance(bounds.radius * 2.4f);
-                m_Camera->setLookAt({ -bounds.center.x, bounds.center.z, bounds.center.y });
-            }
+        if (m_SharedCamera) {
+            *m_SharedCamera = m_Camera;
         }
+
+        m_Renderer->frameCamera(m_Camera.get());
     }
 
-    updateCamera();
+    m_Renderer->setCamera(m_Camera.get());
 
     connect(
         m_Camera.get(),
         &Camera::cameraMoved,
         this,
         [this](){
-            updateCamera();
-            update();
-        });
+            m_Renderer->setCamera(m_Camera.get());
+            m_Renderer->setInteracting(true);
+            m_IdleTimer.start(IdleDelay);
 
-    auto f = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_2_1>(
-        QOpenGLContext::currentContext());
-
-    f->glEnable(GL_DEPTH_TEST);
-    f->glDepthFunc(GL_LEQUAL);
-    f->glClearColor(0.18, 0.18, 0.18, 1.0);
+            // Hidden previews repaint once they are shown again
+            if (isExposed()) {
+                update();
+            }
+            else {
+                m_NeedsRepaint = true;
+            }
+        });
 }
 
 void NifWidget::paintGL()
 {
-    auto f = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_2_1>(
-        QOpenGLContext::currentContext());
-    f->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    for (auto& shape : m_GLShapes) {
-        auto program = m_ShaderManager->getProgram(shape.shaderType);
-        if (program && program->isLinked() && program->bind()) {
-            auto binder = QOpenGLVertexArrayObject::Binder(shape.vertexArray);
-
-            auto& modelMatrix = shape.modelMatrix;
-            auto modelViewMatrix = m_ViewMatrix * modelMatrix;
-            auto mvpMatrix = m_ProjectionMatrix * modelViewMatrix;
-
-            program->setUniformValue("worldMatrix", modelMatrix);
-            program->setUniformValue("viewMatrix", m_ViewMatrix);
-            program->setUniformValue("modelViewMatrix", modelViewMatrix);
-            program->setUniformValue("modelViewMatrixInverse", modelViewMatrix.inverted());
-            program->setUniformValue("normalMatrix", modelViewMatrix.normalMatrix());
-            program->setUniformValue("mvpMatrix", mvpMatrix);
-            program->setUniformValue("lightDirection", QVector3D(0, 0, 1));
-
-            shape.setupShaders(program);
-
-            if (shape.indexBuffer && shape.indexBuffer->isCreated()) {
-                shape.indexBuffer->bind();
-                f->glDrawElements(GL_TRIANGLES, shape.elements, GL_UNSIGNED_SHORT, nullptr);
-                shape.indexBuffer->release();
-            }
+    m_Renderer->render();
 
-            program->release();
-        }
+    // Partially uploaded textures continue in the next frame
+    if (m_Renderer->isUploading()) {
+        update();
+    }
+
+    if (m_Renderer->drawCount() != m_DrawCount || m_Renderer->culledCount() != m_CulledCount) {
+        m_DrawCount = m_Renderer->drawCount();
+        m_CulledCount = m_Renderer->culledCount();
+        emit drawCountChanged(m_DrawCount, m_CulledCount);
+    }
+
+    if (m_TraceSummary && !m_Renderer->hasPendingTextures()) {
+        qInfo(qUtf8Printable(m_TraceSummary->toString()));
+
+        auto stats = m_Renderer->stateStats();
+        qInfo(qUtf8Printable(tr("Drew %1 shapes with %2 state changes, %3 avoided, %4 culled")
+                                 .arg(m_DrawCount)
+                                 .arg(stats.applied)
+                                 .arg(stats.avoided)
+                                 .arg(m_CulledCount)));
+        Trace::instance().flush();
+
+        // Rebuilds after the resources are released aren't part of the load
+        m_TraceSummary.reset();
+        m_Renderer->setTraceSummary(nullptr);
     }
 }
 
 void NifWidget::resizeGL(int w, int h)
 {
-    QMatrix4x4 m;
-    m.perspective(40.0f, static_cast<float>(w) / h, 0.1f, 10000.0f);
-
-    m_ProjectionMatrix = m;
+    m_Renderer->setViewport(w, h);
     m_ViewportWidth = w;
     m_ViewportHeight = h;
 }
 
-void NifWidget::cleanup()
+void NifWidget::releaseResources()
 {
-    makeCurrent();
-
-    for (auto& shape : m_GLShapes) {
-        shape.destroy();
+    if (!m_Renderer->hasResources() || isExposed()) {
+        return;
     }
-    m_GLShapes.clear();
 
-    m_TextureManager->cleanup();
+    qDebug(qUtf8Printable(tr("Releasing GPU resources of hidden preview")));
+
+    cleanup();
+    doneCurrent();
+}
+
+void NifWidget::cleanup()
+{
+    makeCurrent();
+    m_Renderer->destroy();
 }
 
-void NifWidget::updateCamera()
+bool NifWidget::isExposed() const
 {
-    QMatrix4x4 m;
-    m.translate(0.0f, 0.0f, -m_Camera->distance());
-    m.rotate(m_Camera->pitch(), 1.0f, 0.0f, 0.0f);
-    m.rotate(m_Camera->yaw(), 0.0f, 1.0f, 0.0f);
-    m.translate(-m_Camera->lookAt());
-    m *= QMatrix4x4{
-        -1, 0, 0, 0,
-         0, 0, 1, 0,
-         0, 1, 0, 0,
-         0, 0, 0, 1,
-    };
-    m_ViewMatrix = m;
+    return isVisible() && !visibleRegion().isEmpty();
 }
@@ -1,16 +1,14 @@
 #pragma once
 
 #include "Camera.h"
-#include "OpenGLShape.h"
-#include "ShaderManager.h"
-#include "TextureManager.h"
+#include "LodGrid.h"
+#include "NifRenderer.h"
+#include "SceneRenderer.h"
 
-#include <QOpenGLBuffer>
 #include <QOpenGLDebugLogger>
-#include <QOpenGLShaderProgram>
-#include <QOpenGLVertexArrayObject>
 #include <QOpenGLWidget>
 #include <QSharedPointer>
+#include <QTimer>
 
 #include <imoinfo.h>
 #include <NifFile.hpp>
@@ -29,41 +27,94 @@ public:
         QWidget* parent = nullptr,
         Qt::WindowFlags f = {0});
 
+    // Draws meshes read from the mesh cache
+    NifWidget(
+        std::shared_ptr<CachedMesh> cachedMesh,
+        MOBase::IOrganizer* organizer,
+        bool debugContext = false,
+        QWidget* parent = nullptr,
+        Qt::WindowFlags f = {0});
+
+    // Streams the tiles of a worldspace LOD level around a camera of its own
+    NifWidget(
+        std::shared_ptr<LodGrid> grid,
+        MOBase::IOrganizer* organizer,
+        bool debugContext = false,
+        QWidget* parent = nullptr,
+        Qt::WindowFlags f = {0});
+
     ~NifWidget();
     NifWidget(const NifWidget&) = delete;
     NifWidget(NifWidget&&) = delete;
     NifWidget& operator=(const NifWidget&) = delete;
     NifWidget& operator=(NifWidget&&) = delete;
 
+    // Seconds a hidden widget keeps its GPU resources; 0 or less keeps them forever
+    static void setReleaseDelay(int seconds) { ReleaseDelay = seconds; }
+
+    // Puts the contexts of every widget created afterwards into one share group, so
+    // previews in different windows share the texture cache and shader programs.
+    // Does nothing if the application already has a global share context.
+    static void shareContexts();
+
+    // The file the preview shows, for the mesh cache and to batch LOD files; worldspace
+    // views start out over its tile
+    void setSourceFile(const QString& fileName);
+
+    // The summary and the state changes of that frame are logged once the first frame
+    // with every texture is drawn
+    void setTraceSummary(std::shared_ptr<TraceSummary> summary);
+
+signals:
+    // Emitted after a frame that drew or culled a different number of shapes
+    void drawCountChanged(int drawn, int culled);
+
 protected:
     void mousePressEvent(QMouseEvent* event) override;
     void mouseMoveEvent(QMouseEvent* event) override;
     void wheelEvent(QWheelEvent* event) override;
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
 
     void initializeGL() override;
     void paintGL() override;
     void resizeGL(int w, int h) override;
 
 private:
+    // The shared camera is null for views that keep their own
+    NifWidget(
+        std::unique_ptr<SceneRenderer> renderer,
+        QWeakPointer<Camera>* sharedCamera,
+        bool debugContext,
+        QWidget* parent,
+        Qt::WindowFlags f);
+
+    void releaseResources();
     void cleanup();
-    void updateCamera();
+    bool isExposed() const;
 
     inline static QWeakPointer<Camera> SharedCamera;
+    inline static int ReleaseDelay = 30;
+    inline static constexpr int IdleDelay = 300;
 
-    std::shared_ptr<nifly::NifFile> m_NifFile;
-    MOBase::IOrganizer* m_MOInfo = nullptr;
-
-    std::unique_ptr<TextureManager> m_TextureManager;
-    std::unique_ptr<ShaderManager> m_ShaderManager;
+    std::unique_ptr<SceneRenderer> m_Renderer;
+    QWeakPointer<Camera>* m_SharedCamera;
+    std::shared_ptr<TraceSummary> m_TraceSummary;
 
     QOpenGLDebugLogger* m_Logger = nullptr;
 
-    std::vector<OpenGLShape> m_GLShapes;
-
     QSharedPointer<Camera> m_Camera;
 
-    QMatrix4x4 m_ViewMatrix;
-    QMatrix4x4 m_ProjectionMatrix;
+    // Full detail returns once the camera has been still for a moment
+    QTimer m_IdleTimer;
+
+    // GPU resources are rebuilt on the next paint after release, from the mesh cache
+    // or by parsing the NIF again
+    QTimer m_ReleaseTimer;
+    bool m_NeedsRepaint = false;
+
+    int m_DrawCount = -1;
+    int m_CulledCount = -1;
 
     int m_ViewportWidth;
     int m_ViewportHeight;
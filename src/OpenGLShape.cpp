@@ -1,40 +1,16 @@
 #include "OpenGLShape.h"
 #include "NifExtensions.h"
+#include "Trace.h"
 
 #include <QOpenGLContext>
-#include <QOpenGLFunctions_2_1>
-#include <QOpenGLVersionFunctionsFactory>
-
-template <typename T>
-inline static QOpenGLBuffer* makeVertexBuffer(const std::vector<T>* data, GLuint attrib)
-{
-    QOpenGLBuffer* buffer = nullptr;
-
-    if (data) {
-        buffer = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-        if (buffer->create() && buffer->bind()) {
-            buffer->allocate(data->data(), data->size() * sizeof(T));
-
-            auto f = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_2_1>(
-                QOpenGLContext::currentContext());
-
-            f->glEnableVertexAttribArray(attrib);
-
-            f->glVertexAttribPointer(attrib, sizeof(T) / sizeof(float), GL_FLOAT,
-                                     GL_FALSE, sizeof(T), nullptr);
-
-            buffer->release();
-        }
-    }
-
-    return buffer;
-}
+#include <atomic>
+#include <tuple>
 
 OpenGLShape::OpenGLShape(nifly::NifFile* nifFile, nifly::NiShape* niShape,
-                         TextureManager* textureManager)
+                         const SceneGraph& sceneGraph,
+                         GeometryBuffer* geometryBuffer)
 {
-    auto f = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_2_1>(
-        QOpenGLContext::currentContext());
+    TraceScope scope{ "Create shapes" };
 
     auto shader   = nifFile->GetShader(niShape);
     auto& version = nifFile->GetHeader().GetVersion();
@@ -64,107 +40,27 @@ OpenGLShape::OpenGLShape(nifly::NifFile* nifFile, nifly::NiShape* niShape,
         }
     }
 
-    vertexArray = new QOpenGLVertexArrayObject();
-    vertexArray->create();
-    auto binder = QOpenGLVertexArrayObject::Binder(vertexArray);
-
-    auto xform  = GetShapeTransformToGlobal(nifFile, niShape);
-    modelMatrix = convertTransform(xform);
-
-    f->glVertexAttrib2f(AttribTexCoord, 0.0f, 0.0f);
-    f->glVertexAttrib4f(AttribColor, 1.0f, 1.0f, 1.0f, 1.0f);
-
-    // AMD GPU fails to render without vertex data
-    if (!niShape->HasNormals()) {
-        niShape->SetNormals(true);
-        if (auto geomData = niShape->GetGeomData()) {
-            geomData->RecalcNormals();
-        }
-    }
-
-    if (!niShape->HasTangents()) {
-        niShape->SetTangents(true);
-        if (auto geomData = niShape->GetGeomData()) {
-            geomData->CalcTangentSpace();
-        }
-    }
-
-    if (!niShape->HasUVs()) {
-        niShape->SetUVs(true);
-    }
-
-    if (!niShape->HasVertexColors()) {
-        niShape->SetVertexColors(true);
-    }
-
-    if (auto verts = nifFile->GetVertsForShape(niShape)) {
-        vertexBuffers[AttribPosition] = makeVertexBuffer(verts, AttribPosition);
-    }
-
-    if (auto normals = nifFile->GetNormalsForShape(niShape)) {
-        vertexBuffers[AttribNormal] = makeVertexBuffer(normals, AttribNormal);
-    }
+    modelMatrix = convertTransform(sceneGraph.transformToGlobal(niShape));
 
-    if (auto tangents = nifFile->GetTangentsForShape(niShape)) {
-        vertexBuffers[AttribTangent] = makeVertexBuffer(tangents, AttribTangent);
+    if (auto bounds = sceneGraph.boundingSphere(nifFile, niShape); bounds.radius > 0.0f) {
+        boundsCenter = convertVector3(bounds.center);
+        boundsRadius = bounds.radius;
     }
 
-    if (auto bitangents = nifFile->GetBitangentsForShape(niShape)) {
-        vertexBuffers[AttribBitangent] = makeVertexBuffer(bitangents, AttribBitangent);
-    }
-
-    if (auto uvs = nifFile->GetUvsForShape(niShape)) {
-        vertexBuffers[AttribTexCoord] = makeVertexBuffer(uvs, AttribTexCoord);
-    }
-
-    if (std::vector<nifly::Color4> colors;
-        nifFile->GetColorsForShape(niShape, colors)) {
-        vertexBuffers[AttribColor] = makeVertexBuffer(&colors, AttribColor);
-    }
-
-    indexBuffer = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
-    if (indexBuffer->create() && indexBuffer->bind()) {
-
-        if (std::vector<nifly::Triangle> tris; niShape->GetTriangles(tris)) {
-            indexBuffer->allocate(tris.data(), tris.size() * sizeof(nifly::Triangle));
-        }
-
-        elements = niShape->GetNumTriangles() * 3;
-        indexBuffer->release();
-    }
+    // The geometry buffer fills in a missing tangent frame and the shape's VAO reads
+    // missing UVs and colors from constant attributes
+    geometry = geometryBuffer->append(nifFile, niShape);
+    elements = static_cast<GLsizei>(geometry.indexCount);
 
     if (shader) {
+        hasShaderProperty = true;
+
         if (shader->HasTextureSet()) {
             auto textureSetRef = shader->TextureSetRef();
             auto textureSet    = nifFile->GetHeader().GetBlock(textureSetRef);
 
-            for (std::size_t i = 0; i < textureSet->textures.size(); i++) {
-                auto texturePath = textureSet->textures[i].get();
-                if (!texturePath.empty()) {
-                    textures[i] = textureManager->getTexture(texturePath);
-                }
-
-                if (textures[i] == nullptr) {
-                    switch (i) {
-                    case TextureSlot::BaseMap:
-                        textures[i] = textureManager->getErrorTexture();
-                        break;
-                    case TextureSlot::NormalMap:
-                        textures[i] = textureManager->getFlatNormalTexture();
-                        break;
-                    case TextureSlot::GlowMap:
-                        if (shader->HasGlowmap()) {
-                            textures[i] = textureManager->getBlackTexture();
-                        }
-                        else {
-                            textures[i] = textureManager->getWhiteTexture();
-                        }
-                        break;
-                    default:
-                        textures[i] = nullptr;
-                        break;
-                    }
-                }
+            for (auto& texturePath : textureSet->textures) {
+                texturePaths.push_back(QString::fromStdString(texturePath.get()));
             }
         }
 
@@ -232,141 +128,240 @@ OpenGLShape::OpenGLShape(nifly::NifFile* nifFile, nifly::NiShape* niShape,
             hasWeaponBlood = effectShader->shaderFlags2 & SLSF2::WeaponBlood;
         }
     }
-    else {
-        textures[BaseMap]   = textureManager->getWhiteTexture();
-        textures[NormalMap] = textureManager->getFlatNormalTexture();
-    }
 }
 
-void OpenGLShape::destroy()
+std::uint64_t OpenGLShape::nextRevision()
 {
-    for (std::size_t i = 0; i < ATTRIB_COUNT; i++) {
-        if (vertexBuffers[i]) {
-            vertexBuffers[i]->destroy();
-            delete vertexBuffers[i];
-            vertexBuffers[i] = nullptr;
-        }
-    }
+    static std::atomic<std::uint64_t> revision = 0;
+    return ++revision;
+}
 
-    if (indexBuffer) {
-        indexBuffer->destroy();
-        delete indexBuffer;
-        indexBuffer = nullptr;
-    }
+void OpenGLShape::resolveTextures(TextureManager* textureManager)
+{
+    // Which maps are present feeds into the material uniforms
+    materialRevision = nextRevision();
 
-    if (vertexArray) {
-        vertexArray->destroy();
-        vertexArray->deleteLater();
+    if (!hasShaderProperty) {
+        textures[BaseMap]   = textureManager->getWhiteTexture();
+        textures[NormalMap] = textureManager->getFlatNormalTexture();
+        return;
     }
-}
 
-void OpenGLShape::setupShaders(QOpenGLShaderProgram* program)
-{
-    program->setUniformValue("BaseMap", BaseMap + 1);
-    program->setUniformValue("NormalMap", NormalMap + 1);
-    program->setUniformValue("GlowMap", GlowMap + 1);
-    program->setUniformValue("LightMask", LightMask + 1);
-    program->setUniformValue("hasGlowMap", hasGlowMap && textures[GlowMap] != nullptr);
-    program->setUniformValue("HeightMap", HeightMap + 1);
-    program->setUniformValue("hasHeightMap", textures[HeightMap] != nullptr);
-    program->setUniformValue("DetailMask", DetailMask + 1);
-    program->setUniformValue("hasDetailMask", textures[DetailMask] != nullptr);
-    program->setUniformValue("CubeMap", EnvironmentMap + 1);
-    program->setUniformValue("hasCubeMap", textures[EnvironmentMap] != nullptr);
-    program->setUniformValue("EnvironmentMap", EnvironmentMask + 1);
-    program->setUniformValue("hasEnvMask", textures[EnvironmentMask] != nullptr);
-    program->setUniformValue("TintMask", TintMask + 1);
-    program->setUniformValue("hasTintMask", textures[TintMask] != nullptr);
-    program->setUniformValue("InnerMap", InnerMap + 1);
-    program->setUniformValue("BacklightMap", BacklightMap + 1);
-    program->setUniformValue("SpecularMap", SpecularMap + 1);
-    program->setUniformValue("hasSpecularMap", textures[SpecularMap] != nullptr);
-
-    for (int i = 0; i < textures.size(); i++) {
-        if (textures[i]) {
-            textures[i]->bind(i + 1);
+    for (std::size_t i = 0; i < texturePaths.size() && i < textures.size(); i++) {
+        textures[i] = textureManager->getTexture(texturePaths[i], textureSize);
+
+        // Placeholders stand in until the texture is decoded, or if it fails to load
+        if (textures[i] == nullptr) {
+            switch (i) {
+            case TextureSlot::BaseMap:
+                textures[i] = textureManager->getErrorTexture();
+                break;
+            case TextureSlot::NormalMap:
+                textures[i] = textureManager->getFlatNormalTexture();
+                break;
+            case TextureSlot::GlowMap:
+                if (hasGlowMap) {
+                    textures[i] = textureManager->getBlackTexture();
+                }
+                else {
+                    textures[i] = textureManager->getWhiteTexture();
+                }
+                break;
+            default:
+                textures[i] = nullptr;
+                break;
+            }
         }
     }
+}
 
-    program->setUniformValue("ambientColor", QVector4D(0.2f, 0.2f, 0.2f, 1.0f));
-    program->setUniformValue("diffuseColor", QVector4D(1.0f, 1.0f, 1.0f, 1.0f));
+void OpenGLShape::createVertexArray(GeometryBuffer* geometryBuffer)
+{
+    vertexArray = new QOpenGLVertexArrayObject();
+    vertexArray->create();
+    auto binder = QOpenGLVertexArrayObject::Binder(vertexArray);
 
-    program->setUniformValue("alpha", alpha);
-    program->setUniformValue("tintColor", tintColor);
-    program->setUniformValue("uvScale", uvScale);
-    program->setUniformValue("uvOffset", uvOffset);
-    program->setUniformValue("specColor", specColor);
-    program->setUniformValue("specStrength", specStrength);
-    program->setUniformValue("specGlossiness", specGlossiness);
-    program->setUniformValue("fresnelPower", fresnelPower);
+    geometryBuffer->setupVertexArray(geometry);
+}
 
-    program->setUniformValue("paletteScale", paletteScale);
+const void* OpenGLShape::indexOffset() const
+{
+    return reinterpret_cast<const void*>(geometry.firstIndex * sizeof(std::uint16_t));
+}
 
-    program->setUniformValue("hasEmit", hasEmit);
-    program->setUniformValue("hasSoftlight", hasSoftlight);
-    program->setUniformValue("hasBacklight", hasBacklight);
-    program->setUniformValue("hasRimlight", hasRimlight);
-    program->setUniformValue("hasTintColor", hasTintColor);
-    program->setUniformValue("hasWeaponBlood", hasWeaponBlood);
+void OpenGLShape::createLodVertexArray(
+    GeometryBuffer* geometryBuffer,
+    const std::vector<std::uint16_t>& indices)
+{
+    lodIndexBuffer = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+    lodIndexBuffer->create();
+    lodIndexBuffer->setUsagePattern(QOpenGLBuffer::StaticDraw);
+    lodIndexBuffer->bind();
+    lodIndexBuffer->allocate(
+        indices.data(), static_cast<int>(indices.size() * sizeof(std::uint16_t)));
+    lodIndexBuffer->release();
+
+    lodVertexArray = new QOpenGLVertexArrayObject();
+    lodVertexArray->create();
+    auto binder = QOpenGLVertexArrayObject::Binder(lodVertexArray);
+
+    geometryBuffer->setupVertexArray(geometry, lodIndexBuffer);
+    lodElements = static_cast<GLsizei>(indices.size());
+}
 
-    program->setUniformValue("softlight", softlight);
-    program->setUniformValue("backlightPower", backlightPower);
-    program->setUniformValue("rimPower", rimPower);
-    program->setUniformValue("subsurfaceRolloff", subsurfaceRolloff);
-    program->setUniformValue("doubleSided", doubleSided);
+bool OpenGLShape::sameMaterial(const OpenGLShape& other) const
+{
+    auto material = [](const OpenGLShape& shape) {
+        return std::tie(
+            shape.shaderType,
+            shape.geometry.hasTexCoords,
+            shape.geometry.hasColors,
+            shape.hasShaderProperty,
+            shape.texturePaths,
+            shape.specColor,
+            shape.specStrength,
+            shape.specGlossiness,
+            shape.fresnelPower,
+            shape.paletteScale,
+            shape.hasGlowMap,
+            shape.glowColor,
+            shape.glowMult,
+            shape.alpha,
+            shape.tintColor,
+            shape.uvScale,
+            shape.uvOffset);
+    };
 
-    program->setUniformValue("envReflection", envReflection);
+    auto flags = [](const OpenGLShape& shape) {
+        return std::tie(
+            shape.hasEmit,
+            shape.hasSoftlight,
+            shape.hasBacklight,
+            shape.hasRimlight,
+            shape.hasTintColor,
+            shape.hasWeaponBlood,
+            shape.doubleSided,
+            shape.softlight,
+            shape.backlightPower,
+            shape.rimPower,
+            shape.subsurfaceRolloff,
+            shape.envReflection,
+            shape.innerScale,
+            shape.innerThickness,
+            shape.outerRefraction,
+            shape.outerReflection);
+    };
 
-    if (shaderType == ShaderManager::SKMultilayer) {
-        program->setUniformValue("innerScale", innerScale);
-        program->setUniformValue("innerThickness", innerThickness);
-        program->setUniformValue("outerRefraction", outerRefraction);
-        program->setUniformValue("outerReflection", outerReflection);
-    }
+    auto state = [](const OpenGLShape& shape) {
+        return std::tie(
+            shape.zBufferWrite,
+            shape.zBufferTest,
+            shape.alphaBlendEnable,
+            shape.srcBlendMode,
+            shape.dstBlendMode,
+            shape.alphaTestEnable,
+            shape.alphaTestMode,
+            shape.alphaThreshold);
+    };
 
-    auto f = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_2_1>(
-        QOpenGLContext::currentContext());
+    return material(*this) == material(other) && flags(*this) == flags(other) &&
+           state(*this) == state(other);
+}
 
-    for (std::size_t i = 0; i < ATTRIB_COUNT; i++) {
-        if (vertexBuffers[i]) {
-            f->glEnableVertexAttribArray(i);
-        }
-        else {
-            f->glDisableVertexAttribArray(i);
-        }
+void OpenGLShape::destroy()
+{
+    if (vertexArray) {
+        vertexArray->destroy();
+        vertexArray->deleteLater();
     }
 
-    f->glDepthMask(zBufferWrite ? GL_TRUE : GL_FALSE);
-
-    if (zBufferTest) {
-        f->glEnable(GL_DEPTH_TEST);
-    }
-    else {
-        f->glDisable(GL_DEPTH_TEST);
+    if (lodVertexArray) {
+        lodVertexArray->destroy();
+        lodVertexArray->deleteLater();
     }
 
-    if (doubleSided) {
-        f->glDisable(GL_CULL_FACE);
-    }
-    else {
-        f->glEnable(GL_CULL_FACE);
-        f->glCullFace(GL_BACK);
+    if (lodIndexBuffer) {
+        lodIndexBuffer->destroy();
+        delete lodIndexBuffer;
     }
+}
 
-    if (alphaBlendEnable) {
-        f->glEnable(GL_BLEND);
-        f->glBlendFunc(srcBlendMode, dstBlendMode);
-    }
-    else {
-        f->glDisable(GL_BLEND);
-    }
+void OpenGLShape::updateMatrices(
+    const QMatrix4x4& viewMatrix,
+    const QMatrix4x4& projectionMatrix)
+{
+    modelViewMatrix = viewMatrix * modelMatrix;
+    modelViewMatrixInverse = modelViewMatrix.inverted();
+    normalMatrix = modelViewMatrix.normalMatrix();
+    mvpMatrix = projectionMatrix * modelViewMatrix;
+}
 
-    if (alphaTestEnable) {
-        f->glEnable(GL_ALPHA_TEST);
-        f->glAlphaFunc(alphaTestMode, alphaThreshold);
-    }
-    else {
-        f->glDisable(GL_ALPHA_TEST);
+void OpenGLShape::uploadMatrices(
+    QOpenGLShaderProgram* program,
+    const ShaderManager::UniformLocations& uniforms,
+    const QMatrix4x4& viewMatrix)
+{
+    using U = ShaderManager::Uniform;
+
+    program->setUniformValue(uniforms[U::UniformWorldMatrix], modelMatrix);
+    program->setUniformValue(uniforms[U::UniformViewMatrix], viewMatrix);
+    program->setUniformValue(uniforms[U::UniformModelViewMatrix], modelViewMatrix);
+    program->setUniformValue(
+        uniforms[U::UniformModelViewMatrixInverse], modelViewMatrixInverse);
+    program->setUniformValue(uniforms[U::UniformNormalMatrix], normalMatrix);
+    program->setUniformValue(uniforms[U::UniformMvpMatrix], mvpMatrix);
+}
+
+void OpenGLShape::uploadMaterial(
+    QOpenGLShaderProgram* program,
+    const ShaderManager::UniformLocations& uniforms)
+{
+    using U = ShaderManager::Uniform;
+
+    program->setUniformValue(
+        uniforms[U::UniformHasGlowMap], hasGlowMap && textures[GlowMap] != nullptr);
+    program->setUniformValue(uniforms[U::UniformHasHeightMap], textures[HeightMap] != nullptr);
+    program->setUniformValue(
+        uniforms[U::UniformHasDetailMask], textures[DetailMask] != nullptr);
+    program->setUniformValue(
+        uniforms[U::UniformHasCubeMap], textures[EnvironmentMap] != nullptr);
+    program->setUniformValue(
+        uniforms[U::UniformHasEnvMask], textures[EnvironmentMask] != nullptr);
+    program->setUniformValue(uniforms[U::UniformHasTintMask], textures[TintMask] != nullptr);
+    program->setUniformValue(
+        uniforms[U::UniformHasSpecularMap], textures[SpecularMap] != nullptr);
+
+    program->setUniformValue(uniforms[U::UniformAlpha], alpha);
+    program->setUniformValue(uniforms[U::UniformTintColor], tintColor);
+    program->setUniformValue(uniforms[U::UniformUvScale], uvScale);
+    program->setUniformValue(uniforms[U::UniformUvOffset], uvOffset);
+    program->setUniformValue(uniforms[U::UniformSpecColor], specColor);
+    program->setUniformValue(uniforms[U::UniformSpecStrength], specStrength);
+    program->setUniformValue(uniforms[U::UniformSpecGlossiness], specGlossiness);
+    program->setUniformValue(uniforms[U::UniformFresnelPower], fresnelPower);
+
+    program->setUniformValue(uniforms[U::UniformPaletteScale], paletteScale);
+
+    program->setUniformValue(uniforms[U::UniformHasEmit], hasEmit);
+    program->setUniformValue(uniforms[U::UniformHasSoftlight], hasSoftlight);
+    program->setUniformValue(uniforms[U::UniformHasBacklight], hasBacklight);
+    program->setUniformValue(uniforms[U::UniformHasRimlight], hasRimlight);
+    program->setUniformValue(uniforms[U::UniformHasTintColor], hasTintColor);
+    program->setUniformValue(uniforms[U::UniformHasWeaponBlood], hasWeaponBlood);
+
+    program->setUniformValue(uniforms[U::UniformSoftlight], softlight);
+    program->setUniformValue(uniforms[U::UniformBacklightPower], backlightPower);
+    program->setUniformValue(uniforms[U::UniformRimPower], rimPower);
+    program->setUniformValue(uniforms[U::UniformSubsurfaceRolloff], subsurfaceRolloff);
+    program->setUniformValue(uniforms[U::UniformDoubleSided], doubleSided);
+
+    program->setUniformValue(uniforms[U::UniformEnvReflection], envReflection);
+
+    if (shaderType == ShaderManager::SKMultilayer) {
+        program->setUniformValue(uniforms[U::UniformInnerScale], innerScale);
+        program->setUniformValue(uniforms[U::UniformInnerThickness], innerThickness);
+        program->setUniformValue(uniforms[U::UniformOuterRefraction], outerRefraction);
+        program->setUniformValue(uniforms[U::UniformOuterReflection], outerReflection);
     }
 }
 
@@ -393,3 +388,89 @@ QMatrix4x4 OpenGLShape::convertTransform(nifly::MatTransform transform)
         mat[8], mat[9], mat[10], mat[11], mat[12], mat[13], mat[14], mat[15],
     };
 }
+
+QDataStream& operator<<(QDataStream& stream, const OpenGLShape& shape)
+{
+    auto& geometry = shape.geometry;
+    stream << static_cast<qint32>(shape.shaderType)
+           << static_cast<quint64>(geometry.firstVertex)
+           << static_cast<quint64>(geometry.vertexCount)
+           << static_cast<quint64>(geometry.firstIndex)
+           << static_cast<quint64>(geometry.indexCount) << geometry.hasTexCoords
+           << geometry.hasColors;
+
+    stream << shape.hasShaderProperty
+           << QStringList(shape.texturePaths.begin(), shape.texturePaths.end())
+           << shape.boundsCenter << shape.boundsRadius << shape.modelMatrix;
+
+    stream << shape.specColor << shape.specStrength << shape.specGlossiness
+           << shape.fresnelPower << shape.paletteScale << shape.hasGlowMap
+           << shape.glowColor << shape.glowMult << shape.alpha << shape.tintColor
+           << shape.uvScale << shape.uvOffset;
+
+    stream << shape.hasEmit << shape.hasSoftlight << shape.hasBacklight
+           << shape.hasRimlight << shape.hasTintColor << shape.hasWeaponBlood
+           << shape.doubleSided << shape.softlight << shape.backlightPower
+           << shape.rimPower << shape.subsurfaceRolloff << shape.envReflection;
+
+    stream << shape.innerScale << shape.innerThickness << shape.outerRefraction
+           << shape.outerReflection;
+
+    stream << shape.zBufferWrite << shape.zBufferTest << shape.alphaBlendEnable
+           << static_cast<quint32>(shape.srcBlendMode)
+           << static_cast<quint32>(shape.dstBlendMode) << shape.alphaTestEnable
+           << static_cast<quint32>(shape.alphaTestMode) << shape.alphaThreshold;
+
+    return stream;
+}
+
+QDataStream& operator>>(QDataStream& stream, OpenGLShape& shape)
+{
+    qint32 shaderType;
+    quint64 firstVertex, vertexCount, firstIndex, indexCount;
+    auto& geometry = shape.geometry;
+
+    stream >> shaderType >> firstVertex >> vertexCount >> firstIndex >> indexCount >>
+        geometry.hasTexCoords >> geometry.hasColors;
+
+    // Shader types index the program pools
+    if (shaderType < ShaderManager::None || shaderType >= ShaderManager::SHADER_COUNT) {
+        stream.setStatus(QDataStream::ReadCorruptData);
+        return stream;
+    }
+
+    shape.shaderType = static_cast<ShaderManager::ShaderType>(shaderType);
+    geometry.firstVertex = firstVertex;
+    geometry.vertexCount = vertexCount;
+    geometry.firstIndex = firstIndex;
+    geometry.indexCount = indexCount;
+    shape.elements = static_cast<GLsizei>(indexCount);
+
+    QStringList texturePaths;
+    stream >> shape.hasShaderProperty >> texturePaths >> shape.boundsCenter >>
+        shape.boundsRadius >> shape.modelMatrix;
+    shape.texturePaths.assign(texturePaths.begin(), texturePaths.end());
+
+    stream >> shape.specColor >> shape.specStrength >> shape.specGlossiness >>
+        shape.fresnelPower >> shape.paletteScale >> shape.hasGlowMap >> shape.glowColor >>
+        shape.glowMult >> shape.alpha >> shape.tintColor >> shape.uvScale >> shape.uvOffset;
+
+    stream >> shape.hasEmit >> shape.hasSoftlight >> shape.hasBacklight >>
+        shape.hasRimlight >> shape.hasTintColor >> shape.hasWeaponBlood >>
+        shape.doubleSided >> shape.softlight >> shape.backlightPower >> shape.rimPower >>
+        shape.subsurfaceRolloff >> shape.envReflection;
+
+    stream >> shape.innerScale >> shape.innerThickness >> shape.outerRefraction >>
+        shape.outerReflection;
+
+    quint32 srcBlendMode, dstBlendMode, alphaTestMode;
+    stream >> shape.zBufferWrite >> shape.zBufferTest >> shape.alphaBlendEnable >>
+        srcBlendMode >> dstBlendMode >> shape.alphaTestEnable >> alphaTestMode >>
+        shape.alphaThreshold;
+
+    shape.srcBlendMode = srcBlendMode;
+    shape.dstBlendMode = dstBlendMode;
+    shape.alphaTestMode = alphaTestMode;
+
+    return stream;
+}
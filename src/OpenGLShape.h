@@ -1,11 +1,14 @@
 #pragma once
 
+#include "GeometryBuffer.h"
+#include "SceneGraph.h"
 #include "ShaderManager.h"
 #include "TextureManager.h"
 
 #include <Geometry.hpp>
 #include <NifFile.hpp>
 
+#include <QDataStream>
 #include <QOpenGLBuffer>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLTexture>
@@ -31,13 +34,44 @@ enum TextureSlot
 struct OpenGLShape
 {
 public:
+    // Shapes read back from the mesh cache start out empty
+    OpenGLShape() = default;
+
     OpenGLShape(
         nifly::NifFile* nifFile,
         nifly::NiShape* niShape,
-        TextureManager* textureManager);
+        const SceneGraph& sceneGraph,
+        GeometryBuffer* geometryBuffer);
+
+    // Requires the geometry buffer to be uploaded
+    void createVertexArray(GeometryBuffer* geometryBuffer);
+    void createLodVertexArray(
+        GeometryBuffer* geometryBuffer,
+        const std::vector<std::uint16_t>& indices);
+    const void* indexOffset() const;
+
+    // Whether both shapes draw with the same program, textures and state, so they
+    // only differ in their geometry and transform
+    bool sameMaterial(const OpenGLShape& other) const;
 
     void destroy();
-    void setupShaders(QOpenGLShaderProgram* program);
+
+    // Textures are first requested when the shape becomes visible
+    void resolveTextures(TextureManager* textureManager);
+
+    // Derived matrices only change with the camera, so they are computed once per move
+    void updateMatrices(const QMatrix4x4& viewMatrix, const QMatrix4x4& projectionMatrix);
+
+    void uploadMatrices(
+        QOpenGLShaderProgram* program,
+        const ShaderManager::UniformLocations& uniforms,
+        const QMatrix4x4& viewMatrix);
+    void uploadMaterial(
+        QOpenGLShaderProgram* program,
+        const ShaderManager::UniformLocations& uniforms);
+
+    // Unique across all shapes and cameras, so they can be compared between widgets
+    static std::uint64_t nextRevision();
 
     static QVector2D convertVector2(nifly::Vector2 vector);
     static QVector3D convertVector3(nifly::Vector3 vector);
@@ -48,20 +82,42 @@ public:
 
     QOpenGLVertexArrayObject* vertexArray = nullptr;
 
-    QOpenGLBuffer* vertexBuffers[ATTRIB_COUNT] { nullptr };
-
-    QOpenGLBuffer* indexBuffer = nullptr;
+    GeometryBuffer::Range geometry;
     GLsizei elements = 0;
 
+    // Reduced detail version drawn while the camera moves, once it has been simplified
+    QOpenGLVertexArrayObject* lodVertexArray = nullptr;
+    QOpenGLBuffer* lodIndexBuffer = nullptr;
+    GLsizei lodElements = 0;
+
+    bool hasShaderProperty = false;
+    std::vector<QString> texturePaths;
     std::array<QOpenGLTexture*, 13> textures { nullptr };
 
+    // World space bounding sphere; a negative radius means the shape is never culled
+    QVector3D boundsCenter;
+    float boundsRadius = -1.0f;
+    bool visible = true;
+    bool texturesRequested = false;
+
+    // Largest texture dimension worth loading for the shape's screen coverage so far,
+    // 0 for full resolution
+    int textureSize = 0;
+
     QMatrix4x4 modelMatrix;
+    QMatrix4x4 modelViewMatrix;
+    QMatrix4x4 modelViewMatrixInverse;
+    QMatrix3x3 normalMatrix;
+    QMatrix4x4 mvpMatrix;
+    std::uint64_t cameraRevision = 0;
+    std::uint64_t materialRevision = 0;
+
     QVector3D specColor{ 1.0f, 1.0f, 1.0f };
     float specStrength = 1.0f ;
     float specGlossiness = 1.0f;
-    float fresnelPower;
+    float fresnelPower = 0.0f;
 
-    float paletteScale;
+    float paletteScale = 0.0f;
 
     bool hasGlowMap = false;
     QColor glowColor = QColorConstants::White;
@@ -84,13 +140,13 @@ public:
     float softlight = 0.3f;
     float backlightPower = 0.0f;
     float rimPower = 2.0f;
-    float subsurfaceRolloff;
+    float subsurfaceRolloff = 0.0f;
     float envReflection = 1.0f;
 
     QVector2D innerScale;
-    float innerThickness;
-    float outerRefraction;
-    float outerReflection;
+    float innerThickness = 0.0f;
+    float outerRefraction = 0.0f;
+    float outerReflection = 0.0f;
 
     bool zBufferWrite = true;
     bool zBufferTest = true;
@@ -102,3 +158,8 @@ public:
     GLenum alphaTestMode = GL_GREATER;
     float alphaThreshold = 0.0f;
 };
+
+// Everything the NIF contributes to a shape, so the mesh cache can recreate it without
+// the NIF; GL resources and textures are left out
+QDataStream& operator<<(QDataStream& stream, const OpenGLShape& shape);
+QDataStream& operator>>(QDataStream& stream, OpenGLShape& shape);
@@ -0,0 +1,97 @@
+#include "OrganizerResolver.h"
+
+#include <dataarchives.h>
+#include <iplugingame.h>
+
+#include <QFileInfo>
+
+OrganizerResolver::OrganizerResolver(MOBase::IOrganizer* organizer)
+    : m_MOInfo{ organizer }
+{}
+
+QString OrganizerResolver::resolvePath(const QString& path) const
+{
+    auto key = QDir::cleanPath(QString(path).replace('\\', '/')).toLower();
+
+    auto cached = ResolvedPaths.find(key);
+    if (cached != ResolvedPaths.end()) {
+        return cached->second;
+    }
+
+    auto game = m_MOInfo->managedGame();
+
+    if (!game) {
+        qCritical(qUtf8Printable(
+            QObject::tr("Failed to interface with managed game plugin")));
+        return "";
+    }
+
+    if (ResolvedPaths.size() >= MaxCachedPaths) {
+        ResolvedPaths.clear();
+    }
+
+    auto realPath = resolvePath(m_MOInfo, game, path);
+    ResolvedPaths.emplace(key, realPath);
+    return realPath;
+}
+
+QStringList OrganizerResolver::archives() const
+{
+    if (!Archives) {
+        Archives = findArchives(m_MOInfo);
+    }
+
+    return *Archives;
+}
+
+void OrganizerResolver::clearCache()
+{
+    ResolvedPaths.clear();
+    Archives.reset();
+}
+
+QStringList OrganizerResolver::findArchives(MOBase::IOrganizer* organizer)
+{
+    QStringList archivePaths;
+
+    auto game = organizer->managedGame();
+    if (!game) {
+        return archivePaths;
+    }
+
+    auto gameArchives = game->feature<DataArchives>();
+    if (!gameArchives) {
+        return archivePaths;
+    }
+
+    for (auto& archive : gameArchives->archives(organizer->profile())) {
+        auto bsaPath = resolvePath(organizer, game, archive);
+        if (!bsaPath.isEmpty()) {
+            archivePaths.append(bsaPath);
+        }
+    }
+
+    return archivePaths;
+}
+
+QString OrganizerResolver::resolvePath(
+    MOBase::IOrganizer* organizer,
+    const MOBase::IPluginGame* game,
+    const QString& path)
+{
+    auto dataDir = game->dataDirectory();
+
+    auto realPath = organizer->resolvePath(path);
+    if (!realPath.isEmpty()) {
+        return realPath;
+    }
+
+    auto dataPath = dataDir.absoluteFilePath(QDir::cleanPath(path));
+    dataPath.replace('/', QDir::separator());
+
+    if (QFileInfo::exists(dataPath)) {
+        return dataPath;
+    }
+
+    return "";
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "PathResolver.h"
+
+#include <imoinfo.h>
+
+#include <optional>
+#include <unordered_map>
+
+// Resolves files through MO2's virtual file system and the managed game's archives.
+// Results, including misses, are shared by every resolver on the GUI thread until the
+// cache is cleared.
+class OrganizerResolver : public PathResolver
+{
+public:
+    explicit OrganizerResolver(MOBase::IOrganizer* organizer);
+
+    QString resolvePath(const QString& path) const override;
+    QStringList archives() const override;
+
+    // Resolved archive paths in load order
+    static QStringList findArchives(MOBase::IOrganizer* organizer);
+
+    // Called when the mod list, profile or data directory contents change
+    static void clearCache();
+
+private:
+    static QString resolvePath(
+        MOBase::IOrganizer* organizer,
+        const MOBase::IPluginGame* game,
+        const QString& path);
+
+    inline static constexpr std::size_t MaxCachedPaths = 65536;
+
+    // Keyed by the normalized lower case path; an empty value is a known miss
+    inline static std::unordered_map<QString, QString> ResolvedPaths;
+    inline static std::optional<QStringList> Archives;
+
+    MOBase::IOrganizer* m_MOInfo;
+};
@@ -0,0 +1,34 @@
+#include "PathResolver.h"
+
+#include <QFileInfo>
+
+DirectoryResolver::DirectoryResolver(
+    const QString& dataDirectory,
+    const QStringList& archives)
+    : m_DataDirectory{ dataDirectory }, m_Archives{ archives }
+{}
+
+QString DirectoryResolver::resolvePath(const QString& path) const
+{
+    // Game paths use backslashes, which QDir only understands on Windows
+    auto relative = QDir::cleanPath(QString(path).replace('\\', '/'));
+    auto dataPath = m_DataDirectory.absoluteFilePath(relative);
+
+    if (QFileInfo::exists(dataPath)) {
+        return QDir::toNativeSeparators(dataPath);
+    }
+
+    return "";
+}
+
+QStringList DirectoryResolver::findArchives(const QString& dataDirectory)
+{
+    QStringList archives;
+
+    QDir dir{ dataDirectory };
+    for (auto& name : dir.entryList({ "*.bsa", "*.ba2" }, QDir::Files, QDir::Name)) {
+        archives.append(dir.absoluteFilePath(name));
+    }
+
+    return archives;
+}
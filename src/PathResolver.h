@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QDir>
+#include <QString>
+#include <QStringList>
+
+// Locates game data files for the renderer, so it doesn't depend on where the data
+// comes from. Implementations are only called from the thread owning the renderer.
+class PathResolver
+{
+public:
+    virtual ~PathResolver() = default;
+
+    // Returns the real path of a data relative file, or an empty string if it's
+    // not a loose file
+    virtual QString resolvePath(const QString& path) const = 0;
+
+    // Archives searched for files that aren't loose, in load order
+    virtual QStringList archives() const = 0;
+};
+
+// Resolves files against a plain data directory and a fixed archive list
+class DirectoryResolver : public PathResolver
+{
+public:
+    DirectoryResolver(const QString& dataDirectory, const QStringList& archives = {});
+
+    QString resolvePath(const QString& path) const override;
+    QStringList archives() const override { return m_Archives; }
+
+    // Archives found in the data directory, sorted by name
+    static QStringList findArchives(const QString& dataDirectory);
+
+private:
+    QDir m_DataDirectory;
+    QStringList m_Archives;
+};
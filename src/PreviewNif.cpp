@@ -1,15 +1,72 @@
 #include <NifFile.hpp>
 
 #include "PreviewNif.h"
+#include "ArchiveIndex.h"
+#include "LodGrid.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 #include "NifExtensions.h"
 #include "NifWidget.h"
+#include "OrganizerResolver.h"
+#include "ShaderManager.h"
+#include "TextureCache.h"
+#include "TextureManager.h"
+#include "WorldRenderer.h"
 
+#include <imodlist.h>
+#include <ipluginlist.h>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QFutureWatcher>
 #include <QGridLayout>
+#include <QPromise>
+#include <QStandardPaths>
+#include <QThreadPool>
 #include <filesystem>
 
 bool PreviewNif::init(MOBase::IOrganizer* moInfo)
 {
     m_MOInfo = moInfo;
+
+    ShaderManager::setShaderDirectory(
+        QString("%1/shaders").arg(MOBase::IOrganizer::getPluginDataPath()));
+
+    // Previews open in windows of their own, which would each get a share group
+    NifWidget::shareContexts();
+
+    applySettings();
+
+    m_MOInfo->onPluginSettingChanged(
+        [this](const QString& pluginName, const QString&, const QVariant&, const QVariant&) {
+            if (pluginName == name()) {
+                applySettings();
+            }
+        });
+
+    m_MOInfo->onUserInterfaceInitialized([this](QMainWindow*) {
+        warmArchiveIndex();
+
+        if (m_MOInfo->pluginSetting(name(), "precompile_shaders").toBool()) {
+            ShaderManager::instance().precompile();
+        }
+    });
+    m_MOInfo->onProfileChanged(
+        [this](MOBase::IProfile*, MOBase::IProfile*) { dataChanged(); });
+    m_MOInfo->pluginList()->onRefreshed([this]() { dataChanged(); });
+
+    // Mods being enabled, reordered or replaced change which files win
+    auto modList = m_MOInfo->modList();
+    modList->onModInstalled([this](MOBase::IModInterface*) { dataChanged(); });
+    modList->onModRemoved([this](const QString&) { dataChanged(); });
+    modList->onModMoved([this](const QString&, int, int) { dataChanged(); });
+    modList->onModStateChanged(
+        [this](const std::map<QString, MOBase::IModList::ModStates>&) { dataChanged(); });
+
+    // Programs run through MO2 can write new loose files to the overwrite directory
+    m_MOInfo->onFinishedRun(
+        [](const QString&, unsigned int) { OrganizerResolver::clearCache(); });
+
     return true;
 }
 
@@ -35,7 +92,71 @@ MOBase::VersionInfo PreviewNif::version() const
 
 QList<MOBase::PluginSetting> PreviewNif::settings() const
 {
-    return QList<MOBase::PluginSetting>();
+    return {
+        MOBase::PluginSetting(
+            "archive_index_cache",
+            tr("Save the archive file index to disk so it doesn't need to be rebuilt "
+               "at startup"),
+            true),
+        MOBase::PluginSetting(
+            "texture_cache_mb",
+            tr("Video memory in MB kept for textures of previews that are no longer "
+               "open"),
+            512),
+        MOBase::PluginSetting(
+            "texture_threads",
+            tr("Number of threads used to decode textures (0 for automatic)"),
+            0),
+        MOBase::PluginSetting(
+            "optimize_meshes",
+            tr("Reorder triangles and vertices for GPU cache efficiency before upload"),
+            true),
+        MOBase::PluginSetting(
+            "gpu_release_delay",
+            tr("Seconds after which a hidden preview frees its video memory (0 to "
+               "never free it)"),
+            30),
+        MOBase::PluginSetting(
+            "precompile_shaders",
+            tr("Compile shaders in the background at startup so the first preview "
+               "opens faster"),
+            true),
+        MOBase::PluginSetting(
+            "texture_mip_selection",
+            tr("Only load textures up to the resolution the preview can show, loading "
+               "larger mip levels when zooming in"),
+            true),
+        MOBase::PluginSetting(
+            "texture_upload_mb",
+            tr("Megabytes of texture data uploaded per frame while a preview loads, "
+               "so it stays responsive (0 for no limit)"),
+            16),
+        MOBase::PluginSetting(
+            "lod_triangle_budget",
+            tr("Shapes with more triangles are simplified to about this many, which is "
+               "drawn while the camera moves (0 to always draw full detail)"),
+            50000),
+        MOBase::PluginSetting(
+            "mesh_cache_mb",
+            tr("Disk space in MB for render-ready copies of previewed NIFs, so they open "
+               "faster the next time (0 to disable)"),
+            1024),
+        MOBase::PluginSetting(
+            "lod_world_view",
+            tr("Preview .bto and .btr files together with the rest of their worldspace "
+               "LOD level, loading tiles around the camera"),
+            false),
+        MOBase::PluginSetting(
+            "lod_world_tiles",
+            tr("Most LOD tiles kept loaded in a worldspace preview; the farthest are "
+               "unloaded beyond this"),
+            64),
+        MOBase::PluginSetting(
+            "write_trace",
+            tr("Write a Chrome trace of preview loading to preview_nif/trace.json in "
+               "the cache directory"),
+            false),
+    };
 }
 
 bool PreviewNif::enabledByDefault() const
@@ -50,41 +171,205 @@ std::set<QString> PreviewNif::supportedExtensions() const
 
 QWidget* PreviewNif::genFilePreview(const QString& fileName, const QSize& maxSize) const
 {
-    auto path = std::filesystem::path(fileName.toStdWString());
-    auto nifFile = std::make_shared<nifly::NifFile>(path);
-
-    if (!nifFile->IsValid()) {
-        qWarning(qUtf8Printable(tr("Failed to load file: %1").arg(fileName)));
-        return nullptr;
+    if (m_MOInfo->pluginSetting(name(), "lod_world_view").toBool()) {
+        if (auto grid = LodGrid::scan(fileName); grid && grid->size() > 1) {
+            return genWorldPreview(fileName, std::move(grid));
+        }
     }
 
     auto layout = new QGridLayout();
     layout->setRowStretch(0, 1);
     layout->setColumnStretch(0, 1);
 
-    layout->addWidget(makeLabel(nifFile.get()), 1, 0, 1, 1);
+    auto statusLabel = new QLabel(tr("Loading..."));
+    statusLabel->setAlignment(Qt::AlignCenter);
+    layout->addWidget(statusLabel, 0, 0, 1, 1);
+
+    auto widget = new QWidget();
+    widget->setLayout(layout);
+
+    auto summary = std::make_shared<TraceSummary>(QFileInfo(fileName).fileName());
+
+    // Parse off the GUI thread so the preview pane appears regardless of file size
+    auto watcher = new QFutureWatcher<LoadedNif>(widget);
+    connect(
+        watcher,
+        &QFutureWatcherBase::finished,
+        widget,
+        [this, fileName, layout, statusLabel, watcher, summary]() {
+            auto loaded = watcher->result();
+            watcher->deleteLater();
+
+            if (!loaded.cachedMesh && !loaded.nifFile) {
+                auto message = tr("Failed to load file: %1").arg(fileName);
+                qWarning(qUtf8Printable(message));
+                statusLabel->setText(message);
+                return;
+            }
+
+            layout->removeWidget(statusLabel);
+            statusLabel->deleteLater();
+
+            auto stats = loaded.cachedMesh ? loaded.cachedMesh->stats()
+                                           : CachedMesh::Stats::count(loaded.nifFile.get());
+            auto label = makeLabel(stats);
+            layout->addWidget(label, 1, 0, 1, 1);
+
+            auto nifWidget = loaded.cachedMesh ? new NifWidget(loaded.cachedMesh, m_MOInfo)
+                                               : new NifWidget(loaded.nifFile, m_MOInfo);
+            nifWidget->setSourceFile(fileName);
+            nifWidget->setTraceSummary(summary);
+            layout->addWidget(nifWidget, 0, 0, 1, 1);
+
+            connectDrawCount(nifWidget, label);
+        });
+
+    watcher->setFuture(loadNif(fileName, summary));
+    return widget;
+}
+
+QWidget* PreviewNif::genWorldPreview(
+    const QString& fileName,
+    std::shared_ptr<LodGrid> grid) const
+{
+    auto layout = new QGridLayout();
+    layout->setRowStretch(0, 1);
+    layout->setColumnStretch(0, 1);
+
+    auto label = makeLabel(tr("Worldspace: %1 | Level: %2 | Tiles: %3")
+                               .arg(grid->worldspace())
+                               .arg(grid->level())
+                               .arg(grid->size()));
+    layout->addWidget(label, 1, 0, 1, 1);
 
-    auto nifWidget = new NifWidget(nifFile, m_MOInfo);
+    // Tiles are parsed by the renderer as the camera reaches them
+    auto nifWidget = new NifWidget(std::move(grid), m_MOInfo);
+    nifWidget->setSourceFile(fileName);
+    nifWidget->setTraceSummary(
+        std::make_shared<TraceSummary>(QFileInfo(fileName).fileName()));
     layout->addWidget(nifWidget, 0, 0, 1, 1);
 
+    connectDrawCount(nifWidget, label);
+
     auto widget = new QWidget();
     widget->setLayout(layout);
     return widget;
 }
 
-QLabel* PreviewNif::makeLabel(nifly::NifFile* nifFile) const
+void PreviewNif::connectDrawCount(NifWidget* nifWidget, QLabel* label)
+{
+    connect(
+        nifWidget,
+        &NifWidget::drawCountChanged,
+        label,
+        [label, text = label->text()](int drawn, int culled) {
+            label->setText(tr("%1 | Draws: %2 | Culled: %3").arg(text).arg(drawn).arg(culled));
+        });
+}
+
+QFuture<PreviewNif::LoadedNif> PreviewNif::loadNif(
+    const QString& fileName,
+    std::shared_ptr<TraceSummary> summary)
 {
-    int shapes = 0;
-    int faces = 0;
-    int verts = 0;
+    auto promise = std::make_shared<QPromise<LoadedNif>>();
+    auto future = promise->future();
+    promise->start();
 
-    for (auto& shape : nifFile->GetShapes()) {
-        shapes++;
-        faces += shape->GetNumTriangles();
-        verts += shape->GetNumVertices();
+    QThreadPool::globalInstance()->start([promise, fileName, summary]() {
+        TraceSummary::Bind bind{ summary.get() };
+        LoadedNif loaded;
+
+        loaded.cachedMesh = MeshCache::instance().load(fileName);
+        if (!loaded.cachedMesh) {
+            TraceScope scope{ "Parse NIF" };
+
+            auto path = std::filesystem::path(fileName.toStdWString());
+            loaded.nifFile = std::make_shared<nifly::NifFile>(path);
+
+            if (!loaded.nifFile->IsValid()) {
+                loaded.nifFile.reset();
+            }
+        }
+
+        promise->addResult(loaded);
+        promise->finish();
+    });
+
+    return future;
+}
+
+void PreviewNif::applySettings()
+{
+    auto cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+
+    QString indexFile;
+    if (m_MOInfo->pluginSetting(name(), "archive_index_cache").toBool()) {
+        indexFile = QDir(cacheDir).filePath("preview_nif/archives.idx");
+    }
+
+    ArchiveIndex::instance().setCacheFile(indexFile);
+
+    QString traceFile;
+    if (m_MOInfo->pluginSetting(name(), "write_trace").toBool()) {
+        traceFile = QDir(cacheDir).filePath("preview_nif/trace.json");
+        qInfo(qUtf8Printable(tr("Writing preview trace to %1").arg(traceFile)));
+    }
+
+    Trace::instance().setOutputFile(traceFile);
+
+    auto meshCacheMB = m_MOInfo->pluginSetting(name(), "mesh_cache_mb").toInt();
+    MeshCache::instance().setDirectory(
+        meshCacheMB > 0 ? QDir(cacheDir).filePath("preview_nif/meshes") : QString(),
+        meshCacheMB * 1024LL * 1024LL);
+
+    auto textureCacheMB = m_MOInfo->pluginSetting(name(), "texture_cache_mb").toInt();
+    TextureCache::instance().setBudget(qMax(0, textureCacheMB) * 1024LL * 1024LL);
+
+    TextureManager::setDecodeThreads(
+        m_MOInfo->pluginSetting(name(), "texture_threads").toInt());
+
+    TextureManager::setMipSelection(
+        m_MOInfo->pluginSetting(name(), "texture_mip_selection").toBool());
+
+    auto textureUploadMB = m_MOInfo->pluginSetting(name(), "texture_upload_mb").toInt();
+    TextureManager::setUploadBudget(qMax(0, textureUploadMB) * 1024LL * 1024LL);
+
+    MeshSimplifier::setTriangleBudget(
+        m_MOInfo->pluginSetting(name(), "lod_triangle_budget").toInt());
+
+    MeshOptimizer::instance().setEnabled(
+        m_MOInfo->pluginSetting(name(), "optimize_meshes").toBool());
+
+    WorldRenderer::setTileLimit(
+        m_MOInfo->pluginSetting(name(), "lod_world_tiles").toInt());
+
+    NifWidget::setReleaseDelay(
+        m_MOInfo->pluginSetting(name(), "gpu_release_delay").toInt());
+}
+
+void PreviewNif::dataChanged()
+{
+    OrganizerResolver::clearCache();
+    warmArchiveIndex();
+}
+
+void PreviewNif::warmArchiveIndex()
+{
+    if (m_MOInfo->profile()) {
+        ArchiveIndex::instance().warm(OrganizerResolver::findArchives(m_MOInfo));
     }
+}
 
-    auto text = tr("Verts: %1 | Faces: %2 | Shapes: %3").arg(verts).arg(faces).arg(shapes);
+QLabel* PreviewNif::makeLabel(const CachedMesh::Stats& stats) const
+{
+    return makeLabel(tr("Verts: %1 | Faces: %2 | Shapes: %3")
+                         .arg(stats.vertices)
+                         .arg(stats.faces)
+                         .arg(stats.shapes));
+}
+
+QLabel* PreviewNif::makeLabel(const QString& text) const
+{
     auto label = new QLabel(text);
     label->setWordWrap(true);
     label->setTextInteractionFlags(Qt::TextSelectableByMouse);
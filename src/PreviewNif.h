@@ -1,9 +1,18 @@
 #pragma once
 
 #include <ipluginpreview.h>
+#include <QFuture>
 #include <QLabel>
 #include <NifFile.hpp>
 
+#include "LodGrid.h"
+#include "MeshCache.h"
+#include "Trace.h"
+
+#include <memory>
+
+class NifWidget;
+
 class PreviewNif : public MOBase::IPluginPreview
 {
     Q_OBJECT
@@ -29,7 +38,28 @@ public:
     QWidget* genFilePreview(const QString& fileName, const QSize& maxSize) const override;
 
 private:
-    QLabel* makeLabel(nifly::NifFile* nifFile) const;
+    void applySettings();
+    void dataChanged();
+    void warmArchiveIndex();
+
+    // Either the meshes from the mesh cache or the parsed NIF; both null on failure
+    struct LoadedNif
+    {
+        std::shared_ptr<CachedMesh> cachedMesh;
+        std::shared_ptr<nifly::NifFile> nifFile;
+    };
+
+    static QFuture<LoadedNif> loadNif(
+        const QString& fileName,
+        std::shared_ptr<TraceSummary> summary);
+
+    QWidget* genWorldPreview(const QString& fileName, std::shared_ptr<LodGrid> grid) const;
+
+    // Appends the draw and cull counts of each frame to the label
+    static void connectDrawCount(NifWidget* nifWidget, QLabel* label);
+
+    QLabel* makeLabel(const CachedMesh::Stats& stats) const;
+    QLabel* makeLabel(const QString& text) const;
 
     MOBase::IOrganizer* m_MOInfo;
 };
@@ -0,0 +1,213 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <map>
+
+void GLState::reset(QOpenGLFunctions_2_1* f)
+{
+    m_Functions = f;
+    m_Stats = {};
+
+    m_Program = nullptr;
+    m_ActiveUnit = -1;
+    m_Textures.fill(0);
+    m_Capabilities.fill(-1);
+    m_DepthMask = -1;
+    m_CullFace = 0;
+    m_BlendSrc = 0;
+    m_BlendDst = 0;
+    m_AlphaFunc = 0;
+    m_AlphaRef = -1.0f;
+}
+
+bool GLState::changed(bool different)
+{
+    if (different) {
+        m_Stats.applied++;
+    }
+    else {
+        m_Stats.avoided++;
+    }
+
+    return different;
+}
+
+bool GLState::useProgram(QOpenGLShaderProgram* program)
+{
+    if (changed(m_Program != program)) {
+        if (!program->bind()) {
+            m_Program = nullptr;
+            return false;
+        }
+        m_Program = program;
+    }
+
+    return true;
+}
+
+void GLState::finish()
+{
+    if (m_Program) {
+        m_Program->release();
+        m_Program = nullptr;
+    }
+
+    if (m_ActiveUnit != 0) {
+        m_Functions->glActiveTexture(GL_TEXTURE0);
+        m_ActiveUnit = 0;
+    }
+}
+
+void GLState::bindTexture(int unit, QOpenGLTexture* texture)
+{
+    if (unit < 0 || unit >= static_cast<int>(m_Textures.size())) {
+        texture->bind(unit);
+        m_ActiveUnit = -1;
+        return;
+    }
+
+    if (!changed(m_Textures[unit] != texture->textureId())) {
+        return;
+    }
+
+    if (m_ActiveUnit != unit) {
+        m_Functions->glActiveTexture(GL_TEXTURE0 + unit);
+        m_ActiveUnit = unit;
+    }
+
+    m_Functions->glBindTexture(texture->target(), texture->textureId());
+    m_Textures[unit] = texture->textureId();
+}
+
+void GLState::setCapability(GLenum cap, bool enabled)
+{
+    int index;
+    switch (cap) {
+    case GL_DEPTH_TEST:
+        index = CapDepthTest;
+        break;
+    case GL_CULL_FACE:
+        index = CapCullFace;
+        break;
+    case GL_BLEND:
+        index = CapBlend;
+        break;
+    case GL_ALPHA_TEST:
+        index = CapAlphaTest;
+        break;
+    default:
+        enabled ? m_Functions->glEnable(cap) : m_Functions->glDisable(cap);
+        return;
+    }
+
+    if (changed(m_Capabilities[index] != static_cast<Tristate>(enabled))) {
+        enabled ? m_Functions->glEnable(cap) : m_Functions->glDisable(cap);
+        m_Capabilities[index] = enabled;
+    }
+}
+
+void GLState::setDepthMask(bool enabled)
+{
+    if (changed(m_DepthMask != static_cast<Tristate>(enabled))) {
+        m_Functions->glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+        m_DepthMask = enabled;
+    }
+}
+
+void GLState::setCullFace(GLenum mode)
+{
+    if (changed(m_CullFace != mode)) {
+        m_Functions->glCullFace(mode);
+        m_CullFace = mode;
+    }
+}
+
+void GLState::setBlendFunc(GLenum src, GLenum dst)
+{
+    if (changed(m_BlendSrc != src || m_BlendDst != dst)) {
+        m_Functions->glBlendFunc(src, dst);
+        m_BlendSrc = src;
+        m_BlendDst = dst;
+    }
+}
+
+void GLState::setAlphaFunc(GLenum func, float ref)
+{
+    if (changed(m_AlphaFunc != func || m_AlphaRef != ref)) {
+        m_Functions->glAlphaFunc(func, ref);
+        m_AlphaFunc = func;
+        m_AlphaRef = ref;
+    }
+}
+
+void GLState::applyShape(const OpenGLShape& shape)
+{
+    for (int i = 0; i < shape.textures.size(); i++) {
+        if (shape.textures[i]) {
+            bindTexture(i + 1, shape.textures[i]);
+        }
+    }
+
+    setDepthMask(shape.zBufferWrite);
+    setCapability(GL_DEPTH_TEST, shape.zBufferTest);
+
+    setCapability(GL_CULL_FACE, !shape.doubleSided);
+    if (!shape.doubleSided) {
+        setCullFace(GL_BACK);
+    }
+
+    setCapability(GL_BLEND, shape.alphaBlendEnable);
+    if (shape.alphaBlendEnable) {
+        setBlendFunc(shape.srcBlendMode, shape.dstBlendMode);
+    }
+
+    setCapability(GL_ALPHA_TEST, shape.alphaTestEnable);
+    if (shape.alphaTestEnable) {
+        setAlphaFunc(shape.alphaTestMode, shape.alphaThreshold);
+    }
+}
+
+RenderQueue::Pass RenderQueue::pass(const OpenGLShape& shape)
+{
+    if (shape.alphaBlendEnable) {
+        return PassBlend;
+    }
+    else if (shape.alphaTestEnable) {
+        return PassAlphaTest;
+    }
+    else {
+        return PassOpaque;
+    }
+}
+
+void RenderQueue::build(std::vector<OpenGLShape>& shapes)
+{
+    // Texture sets are numbered in order of first use so the key stays compact
+    std::map<decltype(OpenGLShape::textures), std::uint64_t> textureSets;
+
+    m_Items.clear();
+    m_Items.reserve(shapes.size());
+
+    for (std::size_t i = 0; i < shapes.size(); i++) {
+        auto& shape = shapes[i];
+        auto shapePass = pass(shape);
+
+        // Key layout: pass (2 bits) | shader (6 bits) | texture set (24 bits) | index
+        std::uint64_t key = static_cast<std::uint64_t>(shapePass) << 62;
+
+        // Blending depends on draw order, so blended shapes keep their NIF order
+        if (shapePass != PassBlend) {
+            auto textureSet = textureSets.try_emplace(shape.textures, textureSets.size());
+
+            key |= (static_cast<std::uint64_t>(shape.shaderType) & 0x3F) << 56;
+            key |= (textureSet.first->second & 0xFFFFFF) << 32;
+        }
+
+        key |= i & 0xFFFFFFFF;
+        m_Items.push_back({ key, &shape });
+    }
+
+    std::sort(m_Items.begin(), m_Items.end(), [](const Item& a, const Item& b) {
+        return a.key < b.key;
+    });
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "OpenGLShape.h"
+
+#include <QOpenGLFunctions_2_1>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Shadow copy of the GL state touched while drawing shapes, so redundant program
+// binds, texture binds and capability toggles are never sent to the driver
+class GLState
+{
+public:
+    struct Stats
+    {
+        int applied = 0;
+        int avoided = 0;
+    };
+
+    GLState() = default;
+    GLState(const GLState&) = delete;
+    GLState(GLState&&) = delete;
+    GLState& operator=(const GLState&) = delete;
+    GLState& operator=(GLState&&) = delete;
+
+    // Forgets the tracked state; Qt may change anything between frames
+    void reset(QOpenGLFunctions_2_1* f);
+
+    // Releases the program and restores the active texture unit Qt expects
+    void finish();
+
+    bool useProgram(QOpenGLShaderProgram* program);
+
+    void bindTexture(int unit, QOpenGLTexture* texture);
+    void setCapability(GLenum cap, bool enabled);
+    void setDepthMask(bool enabled);
+    void setCullFace(GLenum mode);
+    void setBlendFunc(GLenum src, GLenum dst);
+    void setAlphaFunc(GLenum func, float ref);
+
+    // Binds the shape's textures and applies its depth, cull, blend and alpha test
+    // settings
+    void applyShape(const OpenGLShape& shape);
+
+    const Stats& stats() const { return m_Stats; }
+
+private:
+    enum Capability
+    {
+        CapDepthTest,
+        CapCullFace,
+        CapBlend,
+        CapAlphaTest,
+        CAP_COUNT,
+    };
+
+    // -1 means unknown, so the first change after a reset is always applied
+    using Tristate = int;
+
+    bool changed(bool different);
+
+    QOpenGLFunctions_2_1* m_Functions = nullptr;
+    Stats m_Stats;
+
+    QOpenGLShaderProgram* m_Program = nullptr;
+    int m_ActiveUnit = -1;
+    std::array<GLuint, 16> m_Textures{};
+    std::array<Tristate, CAP_COUNT> m_Capabilities{};
+    Tristate m_DepthMask = -1;
+    GLenum m_CullFace = 0;
+    GLenum m_BlendSrc = 0;
+    GLenum m_BlendDst = 0;
+    GLenum m_AlphaFunc = 0;
+    float m_AlphaRef = -1.0f;
+};
+
+// Draw order for the shapes of a widget, sorted so shapes sharing a program and
+// texture set are drawn back to back
+class RenderQueue
+{
+public:
+    enum Pass
+    {
+        PassOpaque,
+        PassAlphaTest,
+        PassBlend,
+    };
+
+    struct Item
+    {
+        std::uint64_t key = 0;
+        OpenGLShape* shape = nullptr;
+    };
+
+    RenderQueue() = default;
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue(RenderQueue&&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+    RenderQueue& operator=(RenderQueue&&) = delete;
+
+    // Sort keys depend on the shapes' textures, so this must be called again
+    // whenever textures are resolved
+    void build(std::vector<OpenGLShape>& shapes);
+    void clear() { m_Items.clear(); }
+
+    const std::vector<Item>& items() const { return m_Items; }
+
+    static Pass pass(const OpenGLShape& shape);
+
+private:
+    std::vector<Item> m_Items;
+};
@@ -0,0 +1,71 @@
+#include "SceneGraph.h"
+
+SceneGraph::SceneGraph(nifly::NifFile* nifFile)
+{
+    auto root = nifFile->GetRootNode();
+    if (!root) {
+        return;
+    }
+
+    auto& header = nifFile->GetHeader();
+
+    m_Nodes.push_back({ root, -1, root->GetTransformToParent() });
+    m_Indices.emplace(root, 0);
+
+    // The node list doubles as the traversal queue
+    for (std::size_t i = 0; i < m_Nodes.size(); i++) {
+        auto node = dynamic_cast<nifly::NiNode*>(m_Nodes[i].object);
+        if (!node) {
+            continue;
+        }
+
+        for (auto& childRef : node->childRefs) {
+            auto child = header.GetBlock(childRef);
+
+            // Blocks referenced twice, or cycles in broken files, are only visited once
+            if (!child || m_Indices.count(child)) {
+                continue;
+            }
+
+            auto index = static_cast<int>(m_Nodes.size());
+            auto transform =
+                m_Nodes[i].transformToGlobal.ComposeTransforms(child->GetTransformToParent());
+
+            m_Nodes.push_back({ child, static_cast<int>(i), transform });
+            m_Indices.emplace(child, index);
+        }
+    }
+}
+
+int SceneGraph::indexOf(const nifly::NiAVObject* object) const
+{
+    auto it = m_Indices.find(object);
+    return it != m_Indices.end() ? it->second : -1;
+}
+
+nifly::MatTransform SceneGraph::transformToGlobal(const nifly::NiAVObject* object) const
+{
+    auto index = indexOf(object);
+    if (index < 0) {
+        return object->GetTransformToParent();
+    }
+
+    return m_Nodes[index].transformToGlobal;
+}
+
+nifly::BoundingSphere SceneGraph::boundingSphere(
+    nifly::NifFile* nifFile,
+    nifly::NiShape* niShape) const
+{
+    auto vertices = nifFile->GetVertsForShape(niShape);
+    if (!vertices || vertices->empty()) {
+        return nifly::BoundingSphere();
+    }
+
+    auto bounds = nifly::BoundingSphere(*vertices);
+    auto xform = transformToGlobal(niShape);
+
+    bounds.center = xform.ApplyTransform(bounds.center);
+    bounds.radius = xform.ApplyTransformToDist(bounds.radius);
+    return bounds;
+}
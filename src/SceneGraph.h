@@ -0,0 +1,37 @@
+#pragma once
+
+#include <NifFile.hpp>
+
+#include <unordered_map>
+#include <vector>
+
+// Flattened NiAVObject hierarchy of a NIF with the global transform of every object,
+// built by one top-down traversal from the root. Parents always come before their
+// children, so lookups don't need to walk the block list.
+class SceneGraph
+{
+public:
+    struct Node
+    {
+        nifly::NiAVObject* object = nullptr;
+        int parent = -1;
+        nifly::MatTransform transformToGlobal;
+    };
+
+    explicit SceneGraph(nifly::NifFile* nifFile);
+
+    const std::vector<Node>& nodes() const { return m_Nodes; }
+
+    // Returns -1 for objects that aren't reachable from the root
+    int indexOf(const nifly::NiAVObject* object) const;
+
+    // Unreachable objects fall back to their transform to parent
+    nifly::MatTransform transformToGlobal(const nifly::NiAVObject* object) const;
+
+    // Bounds of the shape's vertices in world space
+    nifly::BoundingSphere boundingSphere(nifly::NifFile* nifFile, nifly::NiShape* niShape) const;
+
+private:
+    std::vector<Node> m_Nodes;
+    std::unordered_map<const nifly::NiAVObject*, int> m_Indices;
+};
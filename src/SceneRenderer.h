@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Camera.h"
+#include "RenderQueue.h"
+#include "Trace.h"
+
+#include <QString>
+
+#include <functional>
+#include <memory>
+
+// What a preview widget drives: a single NIF or a streamed worldspace LOD level
+class SceneRenderer
+{
+public:
+    virtual ~SceneRenderer() = default;
+
+    // The file the preview was opened for
+    virtual void setSourceFile(const QString& fileName) = 0;
+
+    // Loading work is timed in the summary
+    virtual void setTraceSummary(std::shared_ptr<TraceSummary> summary) = 0;
+
+    // Called on the GUI thread whenever there is something new to draw
+    virtual void setReadyCallback(std::function<void()> callback) = 0;
+
+    // Both require the context the resources are used with to be current
+    virtual bool hasResources() const = 0;
+    virtual void createResources() = 0;
+    virtual void destroy() = 0;
+
+    virtual void render() = 0;
+    virtual void setInteracting(bool interacting) = 0;
+
+    virtual void setViewport(int width, int height) = 0;
+    virtual void setCamera(Camera* camera) = 0;
+    virtual void frameCamera(Camera* camera) const = 0;
+
+    // Textures still decoding, or partially uploaded and continued in the next frame
+    virtual bool hasPendingTextures() const = 0;
+    virtual bool isUploading() const = 0;
+
+    virtual GLState::Stats stateStats() const = 0;
+    virtual int drawCount() const = 0;
+    virtual int culledCount() const = 0;
+};
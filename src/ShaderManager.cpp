@@ -1,9 +1,97 @@
 #include "ShaderManager.h"
+#include "OpenGLShape.h"
+#include "Trace.h"
 
-#include <QOpenGLContext>
+#include <QCoreApplication>
+#include <QThread>
+#include <QThreadPool>
 
-ShaderManager::ShaderManager(MOBase::IOrganizer* moInfo) : m_MOInfo{ moInfo }
-{}
+static constexpr std::array<const char*, ShaderManager::UNIFORM_COUNT> UniformNames{
+    "worldMatrix",
+    "viewMatrix",
+    "modelViewMatrix",
+    "modelViewMatrixInverse",
+    "normalMatrix",
+    "mvpMatrix",
+    "lightDirection",
+    "ambientColor",
+    "diffuseColor",
+
+    "hasGlowMap",
+    "hasHeightMap",
+    "hasDetailMask",
+    "hasCubeMap",
+    "hasEnvMask",
+    "hasTintMask",
+    "hasSpecularMap",
+
+    "alpha",
+    "tintColor",
+    "uvScale",
+    "uvOffset",
+    "specColor",
+    "specStrength",
+    "specGlossiness",
+    "fresnelPower",
+    "paletteScale",
+
+    "hasEmit",
+    "hasSoftlight",
+    "hasBacklight",
+    "hasRimlight",
+    "hasTintColor",
+    "hasWeaponBlood",
+
+    "softlight",
+    "backlightPower",
+    "rimPower",
+    "subsurfaceRolloff",
+    "doubleSided",
+    "envReflection",
+
+    "innerScale",
+    "innerThickness",
+    "outerRefraction",
+    "outerReflection",
+};
+
+ShaderManager& ShaderManager::instance()
+{
+    // GL objects must be gone before the application is, so this is never destroyed
+    static ShaderManager* manager = []() {
+        auto manager = new ShaderManager();
+        QObject::connect(
+            qApp,
+            &QCoreApplication::aboutToQuit,
+            [manager]() { manager->clear(); });
+        return manager;
+    }();
+
+    return *manager;
+}
+
+void ShaderManager::attach()
+{
+    if (auto pool = currentPool()) {
+        pool->refs++;
+    }
+}
+
+void ShaderManager::detach()
+{
+    auto pool = currentPool();
+    if (!pool) {
+        return;
+    }
+
+    // Pools without their own context can't outlive the renderers using them
+    if (--pool->refs == 0 && !pool->context) {
+        for (int i = 0; i < SHADER_COUNT; i++) {
+            pool->programs[i].program.reset();
+            pool->loaded[i] = false;
+        }
+    }
+}
 
 QOpenGLShaderProgram* ShaderManager::getProgram(ShaderType type)
 {
@@ -11,14 +99,187 @@ QOpenGLShaderProgram* ShaderManager::getProgram(ShaderType type)
         return nullptr;
     }
 
-    if (m_Programs[type] == nullptr) {
-        m_Programs[type] = loadProgram(type);
+    auto pool = currentPool();
+    if (!pool) {
+        return nullptr;
+    }
+
+    auto& program = pool->programs[type];
+    if (!pool->loaded[type]) {
+        pool->loaded[type] = true;
+        program.program = loadProgram(type);
+        resolveUniforms(program);
+    }
+
+    return program.program.get();
+}
+
+const ShaderManager::UniformLocations& ShaderManager::uniforms(ShaderType type)
+{
+    auto pool = currentPool();
+    if (!pool || type == None || !pool->loaded[type]) {
+        static thread_local UniformLocations noUniforms;
+        noUniforms.fill(-1);
+        return noUniforms;
+    }
+
+    return pool->programs[type].uniforms;
+}
+
+ShaderManager::ProgramState& ShaderManager::programState(ShaderType type)
+{
+    auto pool = currentPool();
+    if (!pool || type == None || !pool->loaded[type]) {
+        static thread_local ProgramState noState;
+        noState = {};
+        return noState;
+    }
+
+    return pool->programs[type].state;
+}
+
+void ShaderManager::precompile()
+{
+    if (!QOpenGLContext::supportsThreadedOpenGL()) {
+        return;
+    }
+
+    // Offscreen surfaces have to be created and destroyed on the GUI thread
+    auto surface = std::shared_ptr<QOffscreenSurface>(
+        new QOffscreenSurface(),
+        [](QOffscreenSurface* surface) {
+            QMetaObject::invokeMethod(
+                qApp, [surface]() { delete surface; }, Qt::QueuedConnection);
+        });
+
+    QSurfaceFormat format;
+    format.setVersion(2, 1);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+
+    surface->setFormat(format);
+    surface->create();
+
+    QThreadPool::globalInstance()->start([surface, format]() {
+        QOpenGLContext context;
+        context.setFormat(format);
+        context.setShareContext(QOpenGLContext::globalShareContext());
+
+        if (!context.create() || !context.makeCurrent(surface.get())) {
+            qWarning("Failed to create shader precompile context");
+            return;
+        }
+
+        for (int type = 0; type < SHADER_COUNT; type++) {
+            loadProgram(static_cast<ShaderType>(type));
+        }
+
+        context.doneCurrent();
+    });
+}
+
+void ShaderManager::clear()
+{
+    while (!m_Pools.empty()) {
+        destroyPool(m_Pools.back().get());
+    }
+}
+
+ShaderManager::Pool* ShaderManager::currentPool()
+{
+    auto context = QOpenGLContext::currentContext();
+    if (!context) {
+        return nullptr;
+    }
+
+    auto group = context->shareGroup();
+
+    // Worker threads can't create offscreen surfaces, so each gets a private pool
+    if (QThread::currentThread() != qApp->thread()) {
+        static thread_local std::unique_ptr<Pool> threadPool;
+        if (!threadPool || threadPool->group != group) {
+            threadPool = std::make_unique<Pool>();
+            threadPool->group = group;
+        }
+        return threadPool.get();
+    }
+
+    if (m_Current && m_Current->group == group) {
+        return m_Current;
+    }
+
+    m_Current = nullptr;
+    for (auto& pool : m_Pools) {
+        if (pool->group == group) {
+            m_Current = pool.get();
+        }
+    }
+
+    // A pool nobody is using can't be shared with the new group, so drop it; previews
+    // only change groups if the global share context couldn't be created
+    for (std::size_t i = 0; i < m_Pools.size();) {
+        auto pool = m_Pools[i].get();
+        if (pool != m_Current && pool->refs == 0) {
+            destroyPool(pool);
+        }
+        else {
+            i++;
+        }
+    }
+
+    if (m_Current) {
+        return m_Current;
+    }
+
+    auto pool = std::make_unique<Pool>();
+    pool->group = group;
+
+    pool->surface = std::make_unique<QOffscreenSurface>();
+    pool->surface->setFormat(context->format());
+    pool->surface->create();
+
+    pool->context = std::make_unique<QOpenGLContext>();
+    pool->context->setFormat(context->format());
+    pool->context->setShareContext(context);
+    if (!pool->context->create()) {
+        qWarning("Failed to create shader cache context");
+        return nullptr;
     }
 
-    return m_Programs[type];
+    m_Pools.push_back(std::move(pool));
+    m_Current = m_Pools.back().get();
+    return m_Current;
 }
 
-QOpenGLShaderProgram* ShaderManager::loadProgram(ShaderType type)
+void ShaderManager::destroyPool(Pool* pool)
+{
+    if (m_Current == pool) {
+        m_Current = nullptr;
+    }
+
+    auto previous = QOpenGLContext::currentContext();
+    auto previousSurface = previous ? previous->surface() : nullptr;
+    bool switchContext = !previous || previous->shareGroup() != pool->group;
+
+    if (switchContext) {
+        pool->context->makeCurrent(pool->surface.get());
+    }
+
+    for (auto& program : pool->programs) {
+        program.program.reset();
+    }
+
+    if (switchContext) {
+        pool->context->doneCurrent();
+
+        if (previous) {
+            previous->makeCurrent(previousSurface);
+        }
+    }
+
+    std::erase_if(m_Pools, [pool](auto& p) { return p.get() == pool; });
+}
+
+std::unique_ptr<QOpenGLShaderProgram> ShaderManager::loadProgram(ShaderType type)
 {
     QString vert;
     QString frag;
@@ -52,14 +313,16 @@ QOpenGLShaderProgram* ShaderManager::loadProgram(ShaderType type)
         return nullptr;
     }
 
-    auto game = m_MOInfo->managedGame();
-    auto dataPath = MOBase::IOrganizer::getPluginDataPath();
-    auto vertexShader = QString("%1/shaders/%2").arg(dataPath).arg(vert);
-    auto fragmentShader = QString("%1/shaders/%2").arg(dataPath).arg(frag);
+    TraceScope scope{ "Compile shaders" };
+
+    auto vertexShader = QString("%1/%2").arg(ShaderDirectory).arg(vert);
+    auto fragmentShader = QString("%1/%2").arg(ShaderDirectory).arg(frag);
 
-    auto program = new QOpenGLShaderProgram(QOpenGLContext::currentContext());
-    program->addShaderFromSourceFile(QOpenGLShader::Vertex, vertexShader);
-    program->addShaderFromSourceFile(QOpenGLShader::Fragment, fragmentShader);
+    // Cacheable shaders are linked from a binary on disk when the sources, driver
+    // and renderer match a previous link
+    auto program = std::make_unique<QOpenGLShaderProgram>();
+    program->addCacheableShaderFromSourceFile(QOpenGLShader::Vertex, vertexShader);
+    program->addCacheableShaderFromSourceFile(QOpenGLShader::Fragment, fragmentShader);
 
     program->bindAttributeLocation("position", AttribPosition);
     program->bindAttributeLocation("normal", AttribNormal);
@@ -72,3 +335,43 @@ QOpenGLShaderProgram* ShaderManager::loadProgram(ShaderType type)
 
     return program;
 }
+
+void ShaderManager::resolveUniforms(Program& entry)
+{
+    entry.uniforms.fill(-1);
+    entry.state = {};
+
+    auto program = entry.program.get();
+    if (!program || !program->isLinked()) {
+        return;
+    }
+
+    for (std::size_t i = 0; i < UNIFORM_COUNT; i++) {
+        entry.uniforms[i] = program->uniformLocation(UniformNames[i]);
+    }
+
+    // Texture units never change, so samplers are assigned once
+    if (program->bind()) {
+        program->setUniformValue("BaseMap", BaseMap + 1);
+        program->setUniformValue("NormalMap", NormalMap + 1);
+        program->setUniformValue("GlowMap", GlowMap + 1);
+        program->setUniformValue("LightMask", LightMask + 1);
+        program->setUniformValue("HeightMap", HeightMap + 1);
+        program->setUniformValue("DetailMask", DetailMask + 1);
+        program->setUniformValue("CubeMap", EnvironmentMap + 1);
+        program->setUniformValue("EnvironmentMap", EnvironmentMask + 1);
+        program->setUniformValue("TintMask", TintMask + 1);
+        program->setUniformValue("InnerMap", InnerMap + 1);
+        program->setUniformValue("BacklightMap", BacklightMap + 1);
+        program->setUniformValue("SpecularMap", SpecularMap + 1);
+
+        program->setUniformValue(
+            entry.uniforms[UniformAmbientColor], QVector4D(0.2f, 0.2f, 0.2f, 1.0f));
+        program->setUniformValue(
+            entry.uniforms[UniformDiffuseColor], QVector4D(1.0f, 1.0f, 1.0f, 1.0f));
+        program->setUniformValue(
+            entry.uniforms[UniformLightDirection], QVector3D(0.0f, 0.0f, 1.0f));
+
+        program->release();
+    }
+}
@@ -1,8 +1,14 @@
 #pragma once
 
-#include <imoinfo.h>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
 #include <QOpenGLShaderProgram>
 
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 enum VertexAttrib
 {
     AttribPosition = 0,
@@ -15,6 +21,10 @@ enum VertexAttrib
     ATTRIB_COUNT,
 };
 
+// Compiled programs shared by every widget of a share group, which preview widgets in
+// any window belong to once NifWidget::shareContexts installed the global share context.
+// Like the texture cache, each pool holds its own offscreen context so the group
+// outlives its widgets. Program binaries are persisted by Qt's shader disk cache.
 class ShaderManager
 {
 public:
@@ -31,18 +41,126 @@ public:
         SHADER_COUNT,
     };
 
-    ShaderManager(MOBase::IOrganizer* moInfo);
-    ~ShaderManager() = default;
+    enum Uniform
+    {
+        UniformWorldMatrix,
+        UniformViewMatrix,
+        UniformModelViewMatrix,
+        UniformModelViewMatrixInverse,
+        UniformNormalMatrix,
+        UniformMvpMatrix,
+        UniformLightDirection,
+        UniformAmbientColor,
+        UniformDiffuseColor,
+
+        UniformHasGlowMap,
+        UniformHasHeightMap,
+        UniformHasDetailMask,
+        UniformHasCubeMap,
+        UniformHasEnvMask,
+        UniformHasTintMask,
+        UniformHasSpecularMap,
+
+        UniformAlpha,
+        UniformTintColor,
+        UniformUvScale,
+        UniformUvOffset,
+        UniformSpecColor,
+        UniformSpecStrength,
+        UniformSpecGlossiness,
+        UniformFresnelPower,
+        UniformPaletteScale,
+
+        UniformHasEmit,
+        UniformHasSoftlight,
+        UniformHasBacklight,
+        UniformHasRimlight,
+        UniformHasTintColor,
+        UniformHasWeaponBlood,
+
+        UniformSoftlight,
+        UniformBacklightPower,
+        UniformRimPower,
+        UniformSubsurfaceRolloff,
+        UniformDoubleSided,
+        UniformEnvReflection,
+
+        UniformInnerScale,
+        UniformInnerThickness,
+        UniformOuterRefraction,
+        UniformOuterReflection,
+
+        UNIFORM_COUNT,
+    };
+
+    using UniformLocations = std::array<int, UNIFORM_COUNT>;
+
+    // What was last uploaded to a program, so unchanged uniforms can be skipped
+    struct ProgramState
+    {
+        const void* shape = nullptr;
+        std::uint64_t materialRevision = 0;
+        std::uint64_t cameraRevision = 0;
+    };
+
+    static ShaderManager& instance();
+
+    // Directory containing the GLSL sources; set once before any program is loaded
+    static void setShaderDirectory(const QString& directory) { ShaderDirectory = directory; }
+
     ShaderManager(const ShaderManager&) = delete;
     ShaderManager(ShaderManager&&) = delete;
     ShaderManager& operator=(const ShaderManager&) = delete;
     ShaderManager& operator=(ShaderManager&&) = delete;
 
+    // References the current context's pool so its programs stay loaded
+    void attach();
+    void detach();
+
+    // Returns the program for the current context's share group, loading it if needed
     QOpenGLShaderProgram* getProgram(ShaderType type);
 
+    // Only valid after getProgram has loaded the program
+    const UniformLocations& uniforms(ShaderType type);
+    ProgramState& programState(ShaderType type);
+
+    // Compiles every program on a background context so the disk cache is warm
+    // before the first preview opens
+    void precompile();
+
+    void clear();
+
 private:
-    QOpenGLShaderProgram* loadProgram(ShaderType type);
+    struct Program
+    {
+        std::unique_ptr<QOpenGLShaderProgram> program;
+        UniformLocations uniforms;
+        ProgramState state;
+    };
+
+    struct Pool
+    {
+        QOpenGLContextGroup* group = nullptr;
+        std::unique_ptr<QOffscreenSurface> surface;
+        std::unique_ptr<QOpenGLContext> context;
+
+        std::array<Program, SHADER_COUNT> programs;
+        bool loaded[SHADER_COUNT] { false };
+        int refs = 0;
+    };
+
+    ShaderManager() = default;
+    ~ShaderManager() = default;
+
+    Pool* currentPool();
+    void destroyPool(Pool* pool);
+
+    static std::unique_ptr<QOpenGLShaderProgram> loadProgram(ShaderType type);
+    static void resolveUniforms(Program& program);
+
+    inline static QString ShaderDirectory;
 
-    MOBase::IOrganizer* m_MOInfo;
-    QOpenGLShaderProgram* m_Programs[SHADER_COUNT] { nullptr };
+    // Only touched on the GUI thread
+    std::vector<std::unique_ptr<Pool>> m_Pools;
+    Pool* m_Current = nullptr;
 };
@@ -0,0 +1,213 @@
+#include "StaticBatcher.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+QVector3D unpackSnorm(const std::int8_t* packed)
+{
+    return QVector3D(
+        qMax(packed[0] / 127.0f, -1.0f),
+        qMax(packed[1] / 127.0f, -1.0f),
+        qMax(packed[2] / 127.0f, -1.0f));
+}
+
+void packSnorm(const QVector3D& vector, std::int8_t* packed)
+{
+    for (int i = 0; i < 3; i++) {
+        packed[i] = static_cast<std::int8_t>(std::lround(qBound(-1.0f, vector[i], 1.0f) * 127.0f));
+    }
+}
+
+QVector3D mapNormal(const QMatrix3x3& normalMatrix, const QVector3D& normal)
+{
+    QVector3D mapped;
+    for (int row = 0; row < 3; row++) {
+        mapped[row] = normalMatrix(row, 0) * normal.x() + normalMatrix(row, 1) * normal.y() +
+                      normalMatrix(row, 2) * normal.z();
+    }
+    return mapped;
+}
+
+// Grows the first sphere to enclose the second
+void mergeSphere(QVector3D& center, float& radius, const QVector3D& otherCenter, float otherRadius)
+{
+    auto offset = otherCenter - center;
+    float distance = offset.length();
+
+    if (distance + otherRadius <= radius) {
+        return;
+    }
+
+    if (distance + radius <= otherRadius) {
+        center = otherCenter;
+        radius = otherRadius;
+        return;
+    }
+
+    float merged = (distance + radius + otherRadius) * 0.5f;
+    center += offset * ((merged - radius) / distance);
+    radius = merged;
+}
+}
+
+std::size_t StaticBatcher::batch(std::vector<OpenGLShape>& shapes, GeometryBuffer& geometryBuffer)
+{
+    TraceScope scope{ "Batch shapes" };
+
+    std::vector<std::vector<std::size_t>> groups;
+    for (std::size_t i = 0; i < shapes.size(); i++) {
+        auto group = groups.end();
+        if (canBatch(shapes[i])) {
+            group = std::find_if(groups.begin(), groups.end(), [&](const auto& members) {
+                auto& first = shapes[members.front()];
+                return canBatch(first) && first.sameMaterial(shapes[i]);
+            });
+        }
+
+        if (group != groups.end()) {
+            group->push_back(i);
+        }
+        else {
+            groups.push_back({ i });
+        }
+    }
+
+    if (groups.size() == shapes.size()) {
+        return 0;
+    }
+
+    auto& layout = geometryBuffer.layout();
+    auto stride = static_cast<std::size_t>(layout.stride);
+    auto& vertices = geometryBuffer.stagedVertices();
+    auto& indices = geometryBuffer.stagedIndices();
+
+    std::vector<OpenGLShape> batched;
+    std::vector<char> batchedVertices;
+    std::vector<std::uint16_t> batchedIndices;
+    batchedVertices.reserve(vertices.size());
+    batchedIndices.reserve(indices.size());
+
+    for (auto& members : groups) {
+        for (std::size_t first = 0; first < members.size();) {
+            // Split where the vertices no longer fit the index format
+            auto end = first;
+            std::size_t vertexCount = 0;
+            while (end < members.size() &&
+                   (end == first ||
+                    vertexCount + shapes[members[end]].geometry.vertexCount <= MaxVertices)) {
+                vertexCount += shapes[members[end]].geometry.vertexCount;
+                end++;
+            }
+
+            auto& shape = batched.emplace_back(shapes[members[first]]);
+            bool merged = end - first > 1;
+            if (merged) {
+                shape.modelMatrix.setToIdentity();
+            }
+
+            auto& range = shape.geometry;
+            range.firstVertex = batchedVertices.size() / stride;
+            range.firstIndex = batchedIndices.size();
+
+            for (auto i = first; i < end; i++) {
+                auto& member = shapes[members[i]];
+                auto& source = member.geometry;
+                auto vertexBase = batchedVertices.size() / stride - range.firstVertex;
+                auto sourceVertices = vertices.data() + source.firstVertex * stride;
+
+                if (merged) {
+                    appendTransformed(
+                        layout,
+                        sourceVertices,
+                        source.vertexCount,
+                        member.modelMatrix,
+                        batchedVertices);
+                }
+                else {
+                    batchedVertices.insert(
+                        batchedVertices.end(),
+                        sourceVertices,
+                        sourceVertices + source.vertexCount * stride);
+                }
+
+                for (std::size_t j = 0; j < source.indexCount; j++) {
+                    batchedIndices.push_back(
+                        static_cast<std::uint16_t>(indices[source.firstIndex + j] + vertexBase));
+                }
+
+                if (i == first) {
+                    continue;
+                }
+
+                // A member that is never culled keeps the whole batch from being culled
+                if (shape.boundsRadius < 0.0f || member.boundsRadius < 0.0f) {
+                    shape.boundsRadius = -1.0f;
+                }
+                else {
+                    mergeSphere(
+                        shape.boundsCenter,
+                        shape.boundsRadius,
+                        member.boundsCenter,
+                        member.boundsRadius);
+                }
+            }
+
+            range.vertexCount = batchedVertices.size() / stride - range.firstVertex;
+            range.indexCount = batchedIndices.size() - range.firstIndex;
+            shape.elements = static_cast<GLsizei>(range.indexCount);
+
+            first = end;
+        }
+    }
+
+    auto mergedAway = shapes.size() - batched.size();
+    shapes = std::move(batched);
+    geometryBuffer.setStaged(std::move(batchedVertices), std::move(batchedIndices));
+
+    return mergedAway;
+}
+
+bool StaticBatcher::canBatch(const OpenGLShape& shape)
+{
+    // Blended shapes are drawn in their own order, and model space normal maps are
+    // relative to the shape's transform
+    return !shape.alphaBlendEnable && shape.shaderType != ShaderManager::SKMSN &&
+           shape.geometry.vertexCount <= MaxVertices;
+}
+
+void StaticBatcher::appendTransformed(
+    const VertexLayout& layout,
+    const char* vertices,
+    std::size_t vertexCount,
+    const QMatrix4x4& modelMatrix,
+    std::vector<char>& out)
+{
+    auto stride = static_cast<std::size_t>(layout.stride);
+    auto normalMatrix = modelMatrix.normalMatrix();
+
+    auto offset = out.size();
+    out.insert(out.end(), vertices, vertices + vertexCount * stride);
+
+    for (auto vertex = out.data() + offset; vertex != out.data() + out.size(); vertex += stride) {
+        float position[3];
+        std::memcpy(position, vertex + layout.position, sizeof(position));
+
+        auto mapped = modelMatrix.map(QVector3D(position[0], position[1], position[2]));
+        position[0] = mapped.x();
+        position[1] = mapped.y();
+        position[2] = mapped.z();
+        std::memcpy(vertex + layout.position, position, sizeof(position));
+
+        // Missing tangent frames are zero and stay that way
+        auto normal = reinterpret_cast<std::int8_t*>(vertex + layout.normal);
+        auto tangent = reinterpret_cast<std::int8_t*>(vertex + layout.tangent);
+        auto bitangent = reinterpret_cast<std::int8_t*>(vertex + layout.bitangent);
+        packSnorm(mapNormal(normalMatrix, unpackSnorm(normal)).normalized(), normal);
+        packSnorm(modelMatrix.mapVector(unpackSnorm(tangent)).normalized(), tangent);
+        packSnorm(modelMatrix.mapVector(unpackSnorm(bitangent)).normalized(), bitangent);
+    }
+}
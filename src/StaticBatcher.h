@@ -0,0 +1,36 @@
+#pragma once
+
+#include "GeometryBuffer.h"
+#include "OpenGLShape.h"
+
+#include <QMatrix4x4>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Merges shapes that only differ in their geometry and transform into shared ranges of
+// the geometry buffer, with the transforms applied to the vertices. Object and terrain
+// LOD files are made of many small shapes using a few materials, which this turns into
+// a few draws.
+class StaticBatcher
+{
+public:
+    // Requires the geometry buffer to be packed and not uploaded, and the shapes not
+    // to have GL resources yet. Returns the number of shapes merged away.
+    static std::size_t batch(std::vector<OpenGLShape>& shapes, GeometryBuffer& geometryBuffer);
+
+private:
+    // Batches are drawn with 16 bit indices
+    inline static constexpr std::size_t MaxVertices = 65536;
+
+    static bool canBatch(const OpenGLShape& shape);
+
+    // Copies the range's vertices to the end of out, moved into world space
+    static void appendTransformed(
+        const VertexLayout& layout,
+        const char* vertices,
+        std::size_t vertexCount,
+        const QMatrix4x4& modelMatrix,
+        std::vector<char>& out);
+};
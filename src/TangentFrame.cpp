@@ -0,0 +1,323 @@
+#include "TangentFrame.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PREVIEW_NIF_SSE2
+#endif
+
+namespace
+{
+#ifdef PREVIEW_NIF_SSE2
+
+// xyz with w kept at zero
+struct Vec4
+{
+    __m128 v;
+};
+
+inline Vec4 zero()
+{
+    return { _mm_setzero_ps() };
+}
+
+inline Vec4 set(float x, float y, float z)
+{
+    return { _mm_set_ps(0.0f, z, y, x) };
+}
+
+// Reads 16 bytes; the layout always has other attributes after the position
+inline Vec4 loadPosition(const char* data)
+{
+    const __m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    return { _mm_and_ps(_mm_loadu_ps(reinterpret_cast<const float*>(data)), mask) };
+}
+
+inline Vec4 load(const float* data)
+{
+    return { _mm_load_ps(data) };
+}
+
+inline void store(float* data, Vec4 a)
+{
+    _mm_store_ps(data, a.v);
+}
+
+inline Vec4 operator+(Vec4 a, Vec4 b)
+{
+    return { _mm_add_ps(a.v, b.v) };
+}
+
+inline Vec4 operator-(Vec4 a, Vec4 b)
+{
+    return { _mm_sub_ps(a.v, b.v) };
+}
+
+inline Vec4 operator*(Vec4 a, float s)
+{
+    return { _mm_mul_ps(a.v, _mm_set1_ps(s)) };
+}
+
+inline Vec4 cross(Vec4 a, Vec4 b)
+{
+    auto aYZX = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 0, 2, 1));
+    auto bYZX = _mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(3, 0, 2, 1));
+    auto c = _mm_sub_ps(_mm_mul_ps(a.v, bYZX), _mm_mul_ps(aYZX, b.v));
+    return { _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)) };
+}
+
+inline float dot(Vec4 a, Vec4 b)
+{
+    auto m = _mm_mul_ps(a.v, b.v);
+    auto s = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+    s = _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(s);
+}
+
+// Packs to three signed normalized bytes, the fourth byte is zero
+inline void packSnorm(Vec4 a, char* out)
+{
+    auto scaled = _mm_mul_ps(a.v, _mm_set1_ps(127.0f));
+    auto ints = _mm_cvtps_epi32(scaled);
+    auto shorts = _mm_packs_epi32(ints, ints);
+    auto bytes = _mm_packs_epi16(shorts, shorts);
+    auto packed = _mm_cvtsi128_si32(bytes);
+    std::memcpy(out, &packed, 4);
+}
+
+#else
+
+struct Vec4
+{
+    float x, y, z, w;
+};
+
+inline Vec4 zero()
+{
+    return { 0.0f, 0.0f, 0.0f, 0.0f };
+}
+
+inline Vec4 set(float x, float y, float z)
+{
+    return { x, y, z, 0.0f };
+}
+
+inline Vec4 loadPosition(const char* data)
+{
+    float p[3];
+    std::memcpy(p, data, sizeof(p));
+    return { p[0], p[1], p[2], 0.0f };
+}
+
+inline Vec4 load(const float* data)
+{
+    return { data[0], data[1], data[2], data[3] };
+}
+
+inline void store(float* data, Vec4 a)
+{
+    data[0] = a.x;
+    data[1] = a.y;
+    data[2] = a.z;
+    data[3] = a.w;
+}
+
+inline Vec4 operator+(Vec4 a, Vec4 b)
+{
+    return { a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w };
+}
+
+inline Vec4 operator-(Vec4 a, Vec4 b)
+{
+    return { a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w };
+}
+
+inline Vec4 operator*(Vec4 a, float s)
+{
+    return { a.x * s, a.y * s, a.z * s, a.w * s };
+}
+
+inline Vec4 cross(Vec4 a, Vec4 b)
+{
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x, 0.0f };
+}
+
+inline float dot(Vec4 a, Vec4 b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+inline void packSnorm(Vec4 a, char* out)
+{
+    auto pack = [](float value) {
+        return static_cast<char>(std::lround(std::fmin(std::fmax(value, -1.0f), 1.0f) * 127.0f));
+    };
+
+    out[0] = pack(a.x);
+    out[1] = pack(a.y);
+    out[2] = pack(a.z);
+    out[3] = 0;
+}
+
+#endif
+
+inline constexpr float MinLengthSquared = 1e-12f;
+
+// Returns false and leaves the vector untouched if it's too short to normalize
+inline bool normalize(Vec4& a)
+{
+    float lengthSquared = dot(a, a);
+    if (lengthSquared < MinLengthSquared) {
+        return false;
+    }
+
+    a = a * (1.0f / std::sqrt(lengthSquared));
+    return true;
+}
+
+inline Vec4 unpackSnorm(const char* data)
+{
+    auto packed = reinterpret_cast<const std::int8_t*>(data);
+    return set(packed[0] / 127.0f, packed[1] / 127.0f, packed[2] / 127.0f);
+}
+
+inline Vec4 perpendicular(Vec4 n)
+{
+    auto axis = std::fabs(dot(n, set(1.0f, 0.0f, 0.0f))) < 0.9f ? set(1.0f, 0.0f, 0.0f)
+                                                                 : set(0.0f, 1.0f, 0.0f);
+    auto result = cross(n, axis);
+    normalize(result);
+    return result;
+}
+
+// Gram-Schmidt against the normal, falling back to any perpendicular direction
+inline Vec4 orthogonalize(Vec4 direction, Vec4 n, Vec4 fallback)
+{
+    auto result = direction - n * dot(n, direction);
+    return normalize(result) ? result : fallback;
+}
+
+struct alignas(16) Accumulator
+{
+    float normal[4];
+    float tangent[4];
+    float bitangent[4];
+};
+}
+
+void generateTangentFrame(
+    const VertexLayout& layout,
+    char* vertices,
+    std::size_t vertexCount,
+    const std::uint16_t* indices,
+    std::size_t indexCount,
+    bool normals,
+    bool tangents)
+{
+    if (vertexCount == 0 || (!normals && !tangents)) {
+        return;
+    }
+
+    auto stride = static_cast<std::size_t>(layout.stride);
+
+    auto readUV = [&](std::size_t i, float& u, float& v) {
+        auto data = vertices + i * stride + layout.texCoord;
+        if (layout.halfTexCoord) {
+            std::uint16_t packed[2];
+            std::memcpy(packed, data, sizeof(packed));
+            u = glm::unpackHalf1x16(packed[0]);
+            v = glm::unpackHalf1x16(packed[1]);
+        }
+        else {
+            float uv[2];
+            std::memcpy(uv, data, sizeof(uv));
+            u = uv[0];
+            v = uv[1];
+        }
+    };
+
+    std::vector<Accumulator> accumulated(vertexCount);
+    std::memset(accumulated.data(), 0, accumulated.size() * sizeof(Accumulator));
+
+    for (std::size_t t = 0; t + 2 < indexCount; t += 3) {
+        std::size_t i0 = indices[t];
+        std::size_t i1 = indices[t + 1];
+        std::size_t i2 = indices[t + 2];
+        if (i0 >= vertexCount || i1 >= vertexCount || i2 >= vertexCount) {
+            continue;
+        }
+
+        auto p0 = loadPosition(vertices + i0 * stride + layout.position);
+        auto e1 = loadPosition(vertices + i1 * stride + layout.position) - p0;
+        auto e2 = loadPosition(vertices + i2 * stride + layout.position) - p0;
+
+        if (normals) {
+            // Unnormalized, so larger faces weigh more
+            auto faceNormal = cross(e1, e2);
+            for (auto i : { i0, i1, i2 }) {
+                auto& acc = accumulated[i];
+                store(acc.normal, load(acc.normal) + faceNormal);
+            }
+        }
+
+        if (tangents) {
+            float u0, v0, u1, v1, u2, v2;
+            readUV(i0, u0, v0);
+            readUV(i1, u1, v1);
+            readUV(i2, u2, v2);
+
+            float s1 = u1 - u0;
+            float t1 = v1 - v0;
+            float s2 = u2 - u0;
+            float t2 = v2 - v0;
+
+            float det = s1 * t2 - s2 * t1;
+            if (std::fabs(det) < MinLengthSquared) {
+                continue;
+            }
+
+            float r = 1.0f / det;
+            auto sdir = (e1 * t2 - e2 * t1) * r;
+            auto tdir = (e2 * s1 - e1 * s2) * r;
+
+            for (auto i : { i0, i1, i2 }) {
+                auto& acc = accumulated[i];
+                store(acc.tangent, load(acc.tangent) + tdir);
+                store(acc.bitangent, load(acc.bitangent) + sdir);
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < vertexCount; i++) {
+        auto out = vertices + i * stride;
+        auto& acc = accumulated[i];
+
+        Vec4 n;
+        if (normals) {
+            n = load(acc.normal);
+            if (!normalize(n)) {
+                n = set(0.0f, 0.0f, 1.0f);
+            }
+            packSnorm(n, out + layout.normal);
+        }
+        else {
+            n = unpackSnorm(out + layout.normal);
+            if (!normalize(n)) {
+                n = set(0.0f, 0.0f, 1.0f);
+            }
+        }
+
+        if (tangents) {
+            auto tangent = orthogonalize(load(acc.tangent), n, perpendicular(n));
+            auto bitangent = orthogonalize(load(acc.bitangent), n, cross(n, tangent));
+
+            packSnorm(tangent, out + layout.tangent);
+            packSnorm(bitangent, out + layout.bitangent);
+        }
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "VertexLayout.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Computes smooth normals and/or the tangent frame of interleaved vertices in place,
+// reading positions and UVs from the layout and writing signed normalized bytes to its
+// normal, tangent and bitangent slots. Existing normals are used for the tangent frame
+// when only tangents are generated. The tangent follows V and the bitangent follows U,
+// matching nifly's CalcTangentSpace.
+void generateTangentFrame(
+    const VertexLayout& layout,
+    char* vertices,
+    std::size_t vertexCount,
+    const std::uint16_t* indices,
+    std::size_t indexCount,
+    bool normals,
+    bool tangents);
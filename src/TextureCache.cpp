@@ -0,0 +1,204 @@
+#include "TextureCache.h"
+
+#include <QCoreApplication>
+#include <QThread>
+
+TextureCache& TextureCache::instance()
+{
+    // GL objects must be gone before the application is, so this is never destroyed
+    static TextureCache* cache = []() {
+        auto cache = new TextureCache();
+        QObject::connect(
+            qApp,
+            &QCoreApplication::aboutToQuit,
+            [cache]() { cache->clear(); });
+        return cache;
+    }();
+
+    return *cache;
+}
+
+void TextureCache::setBudget(qint64 bytes)
+{
+    m_Budget = bytes;
+    evict();
+}
+
+QOpenGLTexture* TextureCache::acquire(const QString& key)
+{
+    auto pool = currentPool();
+    if (!pool) {
+        return nullptr;
+    }
+
+    auto it = pool->entries.find(key);
+    if (it == pool->entries.end()) {
+        return nullptr;
+    }
+
+    auto& entry = it->second;
+    if (entry.refs++ == 0) {
+        m_Unused.erase(entry.unused);
+    }
+
+    pool->refs++;
+    return entry.texture;
+}
+
+QOpenGLTexture* TextureCache::insert(
+    const QString& key,
+    QOpenGLTexture* texture,
+    qint64 size)
+{
+    auto pool = currentPool();
+    if (!pool) {
+        return texture;
+    }
+
+    if (pool->entries.contains(key)) {
+        // Another widget got there first; share its copy instead
+        delete texture;
+        return acquire(key);
+    }
+
+    pool->entries[key] = { texture, size, 1, m_Unused.end() };
+    m_Textures[texture] = { pool, key };
+    pool->refs++;
+    m_Size += size;
+
+    evict();
+    return texture;
+}
+
+bool TextureCache::release(QOpenGLTexture* texture)
+{
+    if (QThread::currentThread() != qApp->thread()) {
+        return false;
+    }
+
+    auto it = m_Textures.find(texture);
+    if (it == m_Textures.end()) {
+        return false;
+    }
+
+    auto [pool, key] = it->second;
+    auto& entry = pool->entries.at(key);
+
+    pool->refs--;
+    if (--entry.refs == 0) {
+        entry.unused = m_Unused.insert(m_Unused.end(), { pool, key });
+    }
+
+    evict();
+    return true;
+}
+
+void TextureCache::clear()
+{
+    while (!m_Pools.empty()) {
+        destroyPool(m_Pools.back().get());
+    }
+}
+
+TextureCache::Pool* TextureCache::currentPool()
+{
+    auto context = QOpenGLContext::currentContext();
+    if (!context || QThread::currentThread() != qApp->thread()) {
+        return nullptr;
+    }
+
+    auto group = context->shareGroup();
+
+    Pool* current = nullptr;
+    for (auto& pool : m_Pools) {
+        if (pool->group == group) {
+            current = pool.get();
+        }
+    }
+
+    // A pool nobody is using can't be shared with the new group, so drop it
+    for (std::size_t i = 0; i < m_Pools.size();) {
+        auto pool = m_Pools[i].get();
+        if (pool != current && pool->refs == 0) {
+            destroyPool(pool);
+        }
+        else {
+            i++;
+        }
+    }
+
+    if (current) {
+        return current;
+    }
+
+    auto pool = std::make_unique<Pool>();
+    pool->group = group;
+
+    pool->surface = std::make_unique<QOffscreenSurface>();
+    pool->surface->setFormat(context->format());
+    pool->surface->create();
+
+    pool->context = std::make_unique<QOpenGLContext>();
+    pool->context->setFormat(context->format());
+    pool->context->setShareContext(context);
+    if (!pool->context->create()) {
+        qWarning("Failed to create texture cache context");
+        return nullptr;
+    }
+
+    m_Pools.push_back(std::move(pool));
+    return m_Pools.back().get();
+}
+
+void TextureCache::evict()
+{
+    while (m_Size > m_Budget && !m_Unused.empty()) {
+        auto [pool, key] = m_Unused.front();
+        m_Unused.pop_front();
+
+        auto it = pool->entries.find(key);
+        m_Size -= it->second.size;
+        destroyTexture(pool, it->second.texture);
+        pool->entries.erase(it);
+    }
+}
+
+void TextureCache::destroyPool(Pool* pool)
+{
+    for (auto it = m_Unused.begin(); it != m_Unused.end();) {
+        if (it->first == pool) {
+            it = m_Unused.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    for (auto& [key, entry] : pool->entries) {
+        m_Size -= entry.size;
+        destroyTexture(pool, entry.texture);
+    }
+
+    std::erase_if(m_Pools, [pool](auto& p) { return p.get() == pool; });
+}
+
+void TextureCache::destroyTexture(Pool* pool, QOpenGLTexture* texture)
+{
+    m_Textures.erase(texture);
+
+    auto previous = QOpenGLContext::currentContext();
+    if (previous && previous->shareGroup() == pool->group) {
+        delete texture;
+        return;
+    }
+
+    auto previousSurface = previous ? previous->surface() : nullptr;
+
+    pool->context->makeCurrent(pool->surface.get());
+    delete texture;
+    pool->context->doneCurrent();
+
+    if (previous) {
+        previous->makeCurrent(previousSurface);
+    }
+}
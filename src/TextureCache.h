@@ -0,0 +1,80 @@
+#pragma once
+
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLTexture>
+#include <QString>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Keeps textures alive across preview widgets. Textures are pooled per share group;
+// each pool holds its own offscreen context so the group outlives the widgets using it.
+// Preview widgets share one group, see NifWidget::shareContexts. Pools need offscreen
+// surfaces, so only contexts on the GUI thread are cached.
+class TextureCache
+{
+public:
+    static TextureCache& instance();
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache(TextureCache&&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+    TextureCache& operator=(TextureCache&&) = delete;
+
+    void setBudget(qint64 bytes);
+
+    // Returns a texture from the current context's share group and adds a reference
+    QOpenGLTexture* acquire(const QString& key);
+
+    // Adds a texture to the current context's share group with one reference and
+    // returns the cached texture, which may differ if the key was already present
+    QOpenGLTexture* insert(const QString& key, QOpenGLTexture* texture, qint64 size);
+
+    // Returns false if the texture isn't cached and the caller still owns it
+    bool release(QOpenGLTexture* texture);
+
+    void clear();
+
+private:
+    struct Pool;
+
+    struct Entry
+    {
+        QOpenGLTexture* texture = nullptr;
+        qint64 size = 0;
+        int refs = 0;
+        std::list<std::pair<Pool*, QString>>::iterator unused;
+    };
+
+    struct Pool
+    {
+        QOpenGLContextGroup* group = nullptr;
+        std::unique_ptr<QOffscreenSurface> surface;
+        std::unique_ptr<QOpenGLContext> context;
+
+        std::map<QString, Entry> entries;
+        int refs = 0;
+    };
+
+    TextureCache() = default;
+    ~TextureCache() = default;
+
+    Pool* currentPool();
+    void evict();
+    void destroyPool(Pool* pool);
+    void destroyTexture(Pool* pool, QOpenGLTexture* texture);
+
+    qint64 m_Budget = 512LL * 1024 * 1024;
+    qint64 m_Size = 0;
+
+    std::vector<std::unique_ptr<Pool>> m_Pools;
+    std::list<std::pair<Pool*, QString>> m_Unused;
+
+    // Finds the entry of a released texture without searching every pool
+    std::unordered_map<QOpenGLTexture*, std::pair<Pool*, QString>> m_Textures;
+};
@@ -0,0 +1,146 @@
+#include "TextureData.h"
+
+#include <algorithm>
+
+TextureData::TextureData(gli::texture texture) : m_Texture{ std::move(texture) } {}
+
+TextureData::TextureData(
+    std::shared_ptr<const void> owner,
+    const char* data,
+    const Layout& layout)
+    : m_Owner{ std::move(owner) }, m_Data{ data }, m_Layout{ layout }
+{
+    std::size_t offset = 0;
+    for (std::size_t level = 0; level < layout.levels; level++) {
+        m_LevelOffsets.push_back(offset);
+        offset += levelSize(layout, level);
+    }
+    m_LevelOffsets.push_back(offset);
+}
+
+std::size_t TextureData::chainSize(const Layout& layout)
+{
+    std::size_t size = 0;
+    for (std::size_t level = 0; level < layout.levels; level++) {
+        size += levelSize(layout, level);
+    }
+
+    return size;
+}
+
+bool TextureData::empty() const
+{
+    return m_Data ? false : m_Texture.empty();
+}
+
+gli::target TextureData::target() const
+{
+    return m_Data ? m_Layout.target : m_Texture.target();
+}
+
+gli::format TextureData::format() const
+{
+    return m_Data ? m_Layout.format : m_Texture.format();
+}
+
+gli::swizzles TextureData::swizzles() const
+{
+    return m_Data ? m_Layout.swizzles : m_Texture.swizzles();
+}
+
+std::size_t TextureData::levels() const
+{
+    return m_Data ? m_Layout.levels - m_Layout.baseLevel : m_Texture.levels();
+}
+
+std::size_t TextureData::layers() const
+{
+    return m_Data ? m_Layout.layers : m_Texture.layers();
+}
+
+std::size_t TextureData::faces() const
+{
+    return m_Data ? m_Layout.faces : m_Texture.faces();
+}
+
+gli::extent3d TextureData::extent(std::size_t level) const
+{
+    if (!m_Data) {
+        return m_Texture.extent(level);
+    }
+
+    auto shift = static_cast<int>(m_Layout.baseLevel + level);
+    return glm::max(m_Layout.extent >> shift, gli::extent3d(1));
+}
+
+const void* TextureData::data(std::size_t layer, std::size_t face, std::size_t level) const
+{
+    if (!m_Data) {
+        return m_Texture.data(layer, face, level);
+    }
+
+    // Each layer and face stores its whole mip chain, largest level first
+    auto chain = layer * m_Layout.faces + face;
+    return m_Data + m_Layout.dataOffset + chain * m_LevelOffsets.back() +
+           m_LevelOffsets[m_Layout.baseLevel + level];
+}
+
+std::size_t TextureData::size(std::size_t level) const
+{
+    if (!m_Data) {
+        return m_Texture.size(level);
+    }
+
+    return levelSize(m_Layout, m_Layout.baseLevel + level);
+}
+
+std::size_t TextureData::size() const
+{
+    if (!m_Data) {
+        return m_Texture.size();
+    }
+
+    auto chainSize = m_LevelOffsets.back() - m_LevelOffsets[m_Layout.baseLevel];
+    return chainSize * m_Layout.layers * m_Layout.faces;
+}
+
+void TextureData::prefetch() const
+{
+    if (!m_Data) {
+        return;
+    }
+
+    constexpr std::size_t PageSize = 4096;
+
+    volatile char sink = 0;
+    for (std::size_t layer = 0; layer < layers(); layer++) {
+        for (std::size_t face = 0; face < faces(); face++) {
+            auto begin = static_cast<const char*>(data(layer, face, 0));
+            auto end = begin + m_LevelOffsets.back() - m_LevelOffsets[m_Layout.baseLevel];
+
+            for (auto page = begin; page < end; page += PageSize) {
+                sink = sink + *page;
+            }
+            if (begin < end) {
+                sink = sink + *(end - 1);
+            }
+        }
+    }
+}
+
+std::size_t TextureData::levelSize(const Layout& layout, std::size_t level)
+{
+    auto blockExtent = gli::block_extent(layout.format);
+    auto blockSize = gli::block_size(layout.format);
+
+    auto extent = glm::max(layout.extent >> static_cast<int>(level), gli::extent3d(1));
+
+    // Rounded up to whole blocks without going through int
+    std::size_t size = blockSize;
+    for (int axis = 0; axis < 3; axis++) {
+        auto blockCount = static_cast<std::size_t>(blockExtent[axis]);
+        size *= (static_cast<std::size_t>(extent[axis]) + blockCount - 1) / blockCount;
+    }
+
+    return size;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <gli/gli.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Mip levels ready for upload. Either a texture decoded by gli, or a view of DDS data
+// that stays where it is, in a memory mapped file or an extracted archive entry, so
+// level data is never copied before it reaches the driver.
+class TextureData
+{
+public:
+    struct Layout
+    {
+        gli::target target = gli::TARGET_2D;
+        gli::format format = gli::FORMAT_UNDEFINED;
+        gli::swizzles swizzles{
+            gli::SWIZZLE_RED, gli::SWIZZLE_GREEN, gli::SWIZZLE_BLUE, gli::SWIZZLE_ALPHA };
+
+        // Extent of the file's first level and its level, layer and face counts
+        gli::extent3d extent{ 1, 1, 1 };
+        std::size_t levels = 1;
+        std::size_t layers = 1;
+        std::size_t faces = 1;
+
+        // Offset of the first mip chain from the start of the data
+        std::size_t dataOffset = 0;
+
+        // Levels of the file that are skipped
+        std::size_t baseLevel = 0;
+    };
+
+    TextureData() = default;
+    explicit TextureData(gli::texture texture);
+
+    // The owner keeps the data alive for as long as the view exists
+    TextureData(std::shared_ptr<const void> owner, const char* data, const Layout& layout);
+
+    // Bytes one layer and face of the layout take in the file, including skipped levels
+    static std::size_t chainSize(const Layout& layout);
+
+    bool empty() const;
+
+    gli::target target() const;
+    gli::format format() const;
+    gli::swizzles swizzles() const;
+
+    // Counts and extents exclude skipped levels
+    std::size_t levels() const;
+    std::size_t layers() const;
+    std::size_t faces() const;
+    gli::extent3d extent(std::size_t level = 0) const;
+
+    const void* data(std::size_t layer, std::size_t face, std::size_t level) const;
+    std::size_t size(std::size_t level) const;
+    std::size_t size() const;
+
+    // 0 means the texture is at full resolution
+    std::size_t baseLevel() const { return m_Data ? m_Layout.baseLevel : 0; }
+
+    // Touches every page of a view, so uploading from a mapped file doesn't wait
+    // on disk reads on the GUI thread
+    void prefetch() const;
+
+private:
+    static std::size_t levelSize(const Layout& layout, std::size_t level);
+
+    gli::texture m_Texture;
+
+    std::shared_ptr<const void> m_Owner;
+    const char* m_Data = nullptr;
+    Layout m_Layout;
+
+    // Offset of each file level within a chain, followed by the chain size
+    std::vector<std::size_t> m_LevelOffsets;
+};
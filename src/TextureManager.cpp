@@ -1,28 +1,55 @@
 #include "TextureManager.h"
-#include "PreviewNif.h"
+#include "ArchiveIndex.h"
+#include "DdsLoader.h"
+#include "TextureCache.h"
 
-#include <dataarchives.h>
-#include <iplugingame.h>
-
-#include <gli/gli.hpp>
-#include <libbsarch.h>
-
-#include <QOpenGLContext>
-#include <QOpenGLFunctions_2_1>
-#include <QOpenGLVersionFunctionsFactory>
+#include <QCoreApplication>
+#include <QThread>
 #include <QVector4D>
 
-#include <memory>
+static void releaseTexture(QOpenGLTexture* texture)
+{
+    if (!TextureCache::instance().release(texture)) {
+        delete texture;
+    }
+}
+
+TextureManager::TextureManager(std::shared_ptr<PathResolver> resolver)
+    : m_Resolver{std::move(resolver)}, m_Results{std::make_shared<DecodeResults>()}
+{}
 
-TextureManager::TextureManager(MOBase::IOrganizer* moInfo) : m_MOInfo{moInfo} {}
+TextureManager::~TextureManager()
+{
+    m_Results->onReady = nullptr;
+}
 
 void TextureManager::cleanup()
 {
-    for (auto it = m_Textures.cbegin(); it != m_Textures.cend();) {
-        auto texture = it->second;
-        m_Textures.erase(it++);
-        delete texture;
+    // Decodes still in flight finish into the old results and are dropped
+    m_Results->onReady = nullptr;
+    m_Results = std::make_shared<DecodeResults>();
+    m_Results->onReady = m_OnReady;
+    m_Pending.clear();
+    m_Archives.reset();
+
+    // Textures still too coarse to be shown are only referenced by their upload
+    m_Uploader.clear();
+    for (auto& [texture, upload] : m_Uploads) {
+        if (!upload.visible) {
+            delete texture;
+        }
+    }
+    m_Uploads.clear();
+
+    for (auto& [key, loaded] : m_Textures) {
+        if (loaded.texture) {
+            releaseTexture(loaded.texture);
+        }
     }
+    m_Textures.clear();
+
+    releaseSuperseded();
+    m_Replaced = false;
 
     if (m_ErrorTexture) {
         delete m_ErrorTexture;
@@ -45,28 +72,198 @@ void TextureManager::cleanup()
     }
 }
 
-QOpenGLTexture* TextureManager::getTexture(const std::string& texturePath)
+QOpenGLTexture* TextureManager::getTexture(const std::string& texturePath, int maxSize)
 {
-    return getTexture(QString::fromStdString(texturePath));
+    return getTexture(QString::fromStdString(texturePath), maxSize);
 }
 
-QOpenGLTexture* TextureManager::getTexture(QString texturePath)
+QOpenGLTexture* TextureManager::getTexture(QString texturePath, int maxSize)
 {
     if (texturePath.isEmpty()) {
         return nullptr;
     }
 
-    auto key = texturePath.toLower().toStdWString();
+    maxSize = MipSelection ? quantizeSize(maxSize) : 0;
+
+    auto key = texturePath.toLower();
+    auto& loaded = m_Textures[key];
+
+    // Upgrades wait for the pending load, and failed textures aren't retried
+    if (loaded.failed || m_Pending.count(key) ||
+        (loaded.texture && coversSize(loaded.maxSize, maxSize))) {
+        return loaded.texture;
+    }
+
+    // Another preview may have loaded it already, at this size or larger
+    auto& cache = TextureCache::instance();
+    for (int size = maxSize; size > 0 && size <= MaxTextureSize; size *= 2) {
+        if (auto texture = cache.acquire(cacheKey(key, size))) {
+            replaceTexture(key, texture, size);
+            return texture;
+        }
+    }
+
+    if (auto texture = cache.acquire(cacheKey(key, 0))) {
+        replaceTexture(key, texture, 0);
+        return texture;
+    }
+
+    loadTexture(key, texturePath, maxSize);
+    return loaded.texture;
+}
+
+void TextureManager::replaceTexture(const QString& key, QOpenGLTexture* texture, int maxSize)
+{
+    auto& loaded = m_Textures[key];
+
+    if (loaded.texture) {
+        m_Superseded.push_back(loaded.texture);
+        m_Replaced = true;
+    }
+
+    loaded.texture = texture;
+    loaded.maxSize = maxSize;
+}
+
+void TextureManager::releaseSuperseded()
+{
+    for (auto texture : m_Superseded) {
+        releaseTexture(texture);
+    }
+    m_Superseded.clear();
+}
+
+void TextureManager::setReadyCallback(std::function<void()> callback)
+{
+    m_OnReady = std::move(callback);
+    m_Results->onReady = m_OnReady;
+}
+
+void TextureManager::setTraceSummary(std::shared_ptr<TraceSummary> summary)
+{
+    m_TraceSummary = std::move(summary);
+}
+
+bool TextureManager::uploadPending()
+{
+    std::vector<DecodedTexture> textures;
+    {
+        std::lock_guard lock{ m_Results->mutex };
+        textures.swap(m_Results->textures);
+    }
+
+    for (auto& decoded : textures) {
+        auto size = static_cast<qint64>(decoded.texture.size());
+
+        if (auto glTexture = m_Uploader.add(std::move(decoded.texture))) {
+            m_Uploads[glTexture] = { decoded.key, decoded.maxSize, size };
+        }
+        else {
+            m_Pending.erase(decoded.key);
+            m_Textures[decoded.key].failed = true;
+        }
+    }
+
+    bool uploaded = m_Replaced;
+    if (!m_Uploader.isEmpty()) {
+        TraceScope scope{ "Upload texture" };
+        for (auto& progress : m_Uploader.process(UploadBudget)) {
+            uploaded = updateUpload(progress) || uploaded;
+        }
+    }
+
+    m_Replaced = false;
+    return uploaded;
+}
+
+bool TextureManager::updateUpload(const TextureUploader::Progress& progress)
+{
+    auto& upload = m_Uploads[progress.texture];
+    auto& loaded = m_Textures[upload.key];
+    bool replaced = false;
+
+    // A lower resolution texture stays until the new one is at least as sharp
+    if (!upload.visible &&
+        (progress.finished || !loaded.texture ||
+         progress.size >= qMax(loaded.texture->width(), loaded.texture->height()))) {
+        replaceTexture(upload.key, progress.texture, upload.maxSize);
+        upload.visible = true;
+        replaced = true;
+    }
+
+    if (!progress.finished) {
+        return replaced;
+    }
+
+    m_Pending.erase(upload.key);
+
+    // Another preview may have finished the same texture first
+    auto& cache = TextureCache::instance();
+    auto key = cacheKey(upload.key, upload.maxSize);
+
+    if (auto cached = cache.acquire(key)) {
+        replaceTexture(upload.key, cached, upload.maxSize);
+        replaced = true;
+    }
+    else {
+        cache.insert(key, progress.texture, upload.size);
+    }
+
+    m_Uploads.erase(progress.texture);
+    return replaced;
+}
+
+bool TextureManager::hasPending() const
+{
+    return !m_Pending.empty();
+}
+
+void TextureManager::waitForPending()
+{
+    // Every pending key produces exactly one result, even when decoding fails
+    std::unique_lock lock{ m_Results->mutex };
+    m_Results->decoded.wait(lock, [this]() {
+        return m_Results->textures.size() + m_Uploader.count() >= m_Pending.size();
+    });
+}
+
+void TextureManager::setDecodeThreads(int threads)
+{
+    if (threads <= 0) {
+        threads = qMax(1, QThread::idealThreadCount() - 1);
+    }
+
+    decodePool()->setMaxThreadCount(threads);
+}
+
+int TextureManager::quantizeSize(int maxSize)
+{
+    if (maxSize <= 0) {
+        return 0;
+    }
 
-    auto cached = m_Textures.find(key);
-    if (cached != m_Textures.end()) {
-        return cached->second;
+    int size = MinTextureSize;
+    while (size < maxSize && size < MaxTextureSize) {
+        size *= 2;
     }
 
-    auto texture = loadTexture(texturePath);
+    return size < MaxTextureSize ? size : 0;
+}
+
+bool TextureManager::coversSize(int loadedSize, int maxSize)
+{
+    return loadedSize == 0 || (maxSize != 0 && loadedSize >= maxSize);
+}
+
+QThreadPool* TextureManager::decodePool()
+{
+    static QThreadPool* pool = new QThreadPool(qApp);
+    return pool;
+}
 
-    m_Textures[key] = texture;
-    return texture;
+QString TextureManager::cacheKey(const QString& key, int maxSize)
+{
+    return maxSize > 0 ? QString("%1@%2").arg(key).arg(maxSize) : key;
 }
 
 QOpenGLTexture* TextureManager::getErrorTexture()
@@ -105,178 +302,72 @@ QOpenGLTexture* TextureManager::getFlatNormalTexture()
     return m_FlatNormalTexture;
 }
 
-QOpenGLTexture* TextureManager::loadTexture(QString texturePath)
+void TextureManager::loadTexture(const QString& key, QString texturePath, int maxSize)
 {
-    if (texturePath.isEmpty()) {
-        return nullptr;
-    }
-
-    auto game = m_MOInfo->managedGame();
+    TraceScope scope{ "Resolve texture" };
 
-    if (!game) {
-        qCritical(qUtf8Printable(
-            QObject::tr("Failed to interface with managed game plugin")));
-        return nullptr;
-    }
-
-    auto realPath = resolvePath(game, texturePath);
-    if (!realPath.isEmpty()) {
-        return makeTexture(gli::load(realPath.toStdString()));
+    // The resolver is only queried here on the owning thread; workers just read files
+    auto realPath = m_Resolver->resolvePath(texturePath);
+    if (realPath.isEmpty() && !m_Archives) {
+        m_Archives = m_Resolver->archives();
     }
 
-    auto gameArchives = game->feature<DataArchives>();
-    if (!gameArchives) {
-        return nullptr;
-    }
-
-    auto archives = gameArchives->archives(m_MOInfo->profile());
-    for (auto it = archives.rbegin(); it != archives.rend(); ++it) {
-        auto& archive = *it;
-
-        auto bsaPath = resolvePath(game, archive);
-        if (bsaPath.isEmpty()) {
-            continue;
+    auto archives = realPath.isEmpty() ? *m_Archives : QStringList();
+
+    m_Pending.insert(key);
+    decodePool()->start([results = m_Results, summary = m_TraceSummary, key, texturePath,
+                         realPath, archives, maxSize]() {
+        TraceSummary::Bind bind{ summary.get() };
+        auto decoded = decodeTexture(texturePath, realPath, archives, maxSize);
+        decoded.key = key;
+        {
+            std::lock_guard lock{ results->mutex };
+            results->textures.push_back(std::move(decoded));
         }
+        results->decoded.notify_all();
 
-        using bsa_ptr = std::unique_ptr<void, decltype(&bsa_free)>;
-        auto bsa      = bsa_ptr(bsa_create(), bsa_free);
+        QMetaObject::invokeMethod(
+            qApp,
+            [weak = std::weak_ptr(results)]() {
+                if (auto results = weak.lock(); results && results->onReady) {
+                    results->onReady();
+                }
+            },
+            Qt::QueuedConnection);
+    });
+}
 
-        static_assert(sizeof(wchar_t) == 2, "Expected wchar_t to be 2 bytes");
+TextureManager::DecodedTexture TextureManager::decodeTexture(
+    const QString& texturePath,
+    const QString& realPath,
+    const QStringList& archives,
+    int maxSize)
+{
+    TextureData texture;
 
-        bsa_result_message_t result;
-        auto bsaPath_utf16 = reinterpret_cast<const wchar_t*>(bsaPath.utf16());
-        result             = bsa_load_from_file(bsa.get(), bsaPath_utf16);
-        if (result.code == BSA_RESULT_EXCEPTION) {
-            continue;
-        }
+    if (!realPath.isEmpty()) {
+        TraceScope scope{ "Decode texture" };
+        texture = DdsLoader::load(realPath, maxSize);
 
-        auto texturePath_utf16 = reinterpret_cast<const wchar_t*>(texturePath.utf16());
-        auto result_buffer =
-            bsa_extract_file_data_by_filename(bsa.get(), texturePath_utf16);
-        if (result_buffer.message.code == BSA_RESULT_EXCEPTION) {
-            continue;
+        // Page the mapped levels in here rather than during the upload
+        texture.prefetch();
+    }
+    else {
+        QByteArray data;
+        {
+            TraceScope scope{ "Extract texture" };
+            data = ArchiveIndex::instance().extract(archives, texturePath);
         }
 
-        auto buffer_free = [&bsa](bsa_result_buffer_t* buffer) {
-            bsa_file_data_free(bsa.get(), *buffer);
-        };
-        using buffer_ptr = std::unique_ptr<bsa_result_buffer_t, decltype(buffer_free)>;
-        auto buffer      = buffer_ptr(&result_buffer.buffer, buffer_free);
-
-        auto data = static_cast<char*>(buffer->data);
-        if (auto texture = makeTexture(gli::load(data, buffer->size))) {
-            return texture;
+        if (!data.isEmpty()) {
+            TraceScope scope{ "Decode texture" };
+            texture = DdsLoader::load(data, maxSize);
         }
     }
 
-    return nullptr;
-}
-
-QOpenGLTexture* TextureManager::makeTexture(const gli::texture& texture)
-{
-    if (texture.empty()) {
-        return nullptr;
-    }
-
-    gli::gl GL(gli::gl::PROFILE_GL32);
-    const gli::gl::format format = GL.translate(texture.format(), texture.swizzles());
-    GLenum target                = GL.translate(texture.target());
-
-    auto f = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_2_1>(
-        QOpenGLContext::currentContext());
-    QOpenGLTexture* glTexture =
-        new QOpenGLTexture(static_cast<QOpenGLTexture::Target>(target));
-
-    glTexture->create();
-    glTexture->bind();
-    glTexture->setMipLevels(texture.levels());
-    glTexture->setMipBaseLevel(0);
-    glTexture->setMipMaxLevel(texture.levels() - 1);
-    glTexture->setMinMagFilters(QOpenGLTexture::LinearMipMapLinear,
-                                QOpenGLTexture::Linear);
-    glTexture->setSwizzleMask(
-        static_cast<QOpenGLTexture::SwizzleValue>(format.Swizzles[0]),
-        static_cast<QOpenGLTexture::SwizzleValue>(format.Swizzles[1]),
-        static_cast<QOpenGLTexture::SwizzleValue>(format.Swizzles[2]),
-        static_cast<QOpenGLTexture::SwizzleValue>(format.Swizzles[3]));
-
-    glTexture->setWrapMode(QOpenGLTexture::Repeat);
-
-    auto extent             = texture.extent();
-    const GLsizei faceTotal = texture.layers() * texture.faces();
-
-    glTexture->setSize(extent.x, extent.y, extent.z);
-    glTexture->setFormat(static_cast<QOpenGLTexture::TextureFormat>(format.Internal));
-    glTexture->allocateStorage(
-        static_cast<QOpenGLTexture::PixelFormat>(format.External),
-        static_cast<QOpenGLTexture::PixelType>(format.Type));
-
-    for (std::size_t layer = 0; layer < texture.layers(); layer++)
-        for (std::size_t face = 0; face < texture.faces(); face++)
-            for (std::size_t level = 0; level < texture.levels(); level++) {
-                auto extent = texture.extent(level);
-
-                target =
-                    gli::is_target_cube(texture.target())
-                        ? static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face)
-                        : target;
-
-                // Qt's upload functions lag badly so we just use the GL API
-                switch (texture.target()) {
-                case gli::TARGET_1D:
-                    if (gli::is_compressed(texture.format())) {
-                        f->glCompressedTexSubImage1D(
-                            target, level, 0, extent.x, format.Internal,
-                            texture.size(level), texture.data(layer, face, level));
-                    }
-                    else {
-                        f->glTexSubImage1D(target, level, 0, extent.x, format.External,
-                                           format.Type,
-                                           texture.data(layer, face, level));
-                    }
-                    break;
-                case gli::TARGET_1D_ARRAY:
-                case gli::TARGET_2D:
-                case gli::TARGET_CUBE:
-                    if (gli::is_compressed(texture.format())) {
-                        f->glCompressedTexSubImage2D(
-                            target, level, 0, 0, extent.x,
-                            texture.target() == gli::TARGET_1D_ARRAY ? layer : extent.y,
-                            format.Internal, texture.size(level),
-                            texture.data(layer, face, level));
-                    }
-                    else {
-                        f->glTexSubImage2D(
-                            target, level, 0, 0, extent.x,
-                            texture.target() == gli::TARGET_1D_ARRAY ? layer : extent.y,
-                            format.External, format.Type,
-                            texture.data(layer, face, level));
-                    }
-                    break;
-                case gli::TARGET_2D_ARRAY:
-                case gli::TARGET_3D:
-                case gli::TARGET_CUBE_ARRAY:
-                    if (gli::is_compressed(texture.format())) {
-                        f->glCompressedTexSubImage3D(
-                            target, level, 0, 0, 0, extent.x, extent.y,
-                            texture.target() == gli::TARGET_3D ? extent.z : layer,
-                            format.Internal, texture.size(level),
-                            texture.data(layer, face, level));
-                    }
-                    else {
-                        f->glTexSubImage3D(target, level, 0, 0, 0, extent.x, extent.y,
-                                           texture.target() == gli::TARGET_3D ? extent.z
-                                                                              : layer,
-                                           format.External, format.Type,
-                                           texture.data(layer, face, level));
-                    }
-                    break;
-                }
-            }
-
-    glTexture->release();
-
-    return glTexture;
+    // Textures that fit without skipping a level are complete
+    auto loadedSize = texture.baseLevel() > 0 ? maxSize : 0;
+    return { QString(), loadedSize, std::move(texture) };
 }
 
 QOpenGLTexture* TextureManager::makeSolidColor(QVector4D color)
@@ -295,22 +386,3 @@ QOpenGLTexture* TextureManager::makeSolidColor(QVector4D color)
 
     return glTexture;
 }
-
-QString TextureManager::resolvePath(const MOBase::IPluginGame* game, QString path)
-{
-    auto dataDir = game->dataDirectory();
-
-    auto realPath = m_MOInfo->resolvePath(path);
-    if (!realPath.isEmpty()) {
-        return realPath;
-    }
-
-    auto dataPath = dataDir.absoluteFilePath(QDir::cleanPath(path));
-    dataPath.replace('/', QDir::separator());
-
-    if (QFileInfo::exists(dataPath)) {
-        return dataPath;
-    }
-
-    return "";
-}
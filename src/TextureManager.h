@@ -1,15 +1,27 @@
 #pragma once
 
-#include <imoinfo.h>
-#include <gli/gli.hpp>
+#include "PathResolver.h"
+#include "TextureData.h"
+#include "TextureUploader.h"
+#include "Trace.h"
+
 #include <QOpenGLTexture>
+#include <QThreadPool>
+
+#include <condition_variable>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <vector>
 
 class TextureManager
 {
 public:
-    TextureManager(MOBase::IOrganizer* organizer);
-    ~TextureManager() = default;
+    TextureManager(std::shared_ptr<PathResolver> resolver);
+    ~TextureManager();
     TextureManager(const TextureManager&) = delete;
     TextureManager(TextureManager&&) = delete;
     TextureManager& operator=(const TextureManager&) = delete;
@@ -17,8 +29,50 @@ public:
 
     void cleanup();
 
-    QOpenGLTexture* getTexture(const std::string& texturePath);
-    QOpenGLTexture* getTexture(QString texturePath);
+    // Returns nullptr until the texture has been decoded and uploaded. With mip
+    // selection, maxSize limits the largest dimension loaded (0 for full resolution);
+    // a larger size than before loads the texture again and keeps returning the
+    // smaller one until it's ready.
+    QOpenGLTexture* getTexture(const std::string& texturePath, int maxSize = 0);
+    QOpenGLTexture* getTexture(QString texturePath, int maxSize = 0);
+
+    // Called on the GUI thread when decoded textures are waiting for upload
+    void setReadyCallback(std::function<void()> callback);
+
+    // Decode workers report their timings to the summary
+    void setTraceSummary(std::shared_ptr<TraceSummary> summary);
+
+    // Uploads decoded textures within the frame's budget; requires a current context.
+    // Returns true if any texture became available or was replaced, so shapes need to
+    // resolve them again.
+    bool uploadPending();
+    bool hasPending() const;
+
+    // Frees the lower resolution textures replaced by uploadPending, or hands them back
+    // to the texture cache; requires every shape to have resolved its textures since
+    void releaseSuperseded();
+
+    // Whether textures are partially uploaded and need further frames
+    bool isUploading() const { return !m_Uploader.isEmpty(); }
+
+    // Blocks until every requested texture has been decoded, for renderers without
+    // an event loop to deliver the ready callback
+    void waitForPending();
+
+    static void setDecodeThreads(int threads);
+
+    // Bytes of texture data uploaded per frame, 0 uploads everything at once
+    static void setUploadBudget(qint64 bytes) { UploadBudget = bytes; }
+
+    // Loads textures only from the mip level that fits the requested size
+    static void setMipSelection(bool enabled) { MipSelection = enabled; }
+
+    // Rounds a requested size up to the sizes textures are loaded at; 0 stays full
+    // resolution
+    static int quantizeSize(int maxSize);
+
+    // Whether a texture loaded for one size is enough for another
+    static bool coversSize(int loadedSize, int maxSize);
 
     QOpenGLTexture* getErrorTexture();
     QOpenGLTexture* getBlackTexture();
@@ -26,17 +80,79 @@ public:
     QOpenGLTexture* getFlatNormalTexture();
 
 private:
-    QOpenGLTexture* loadTexture(QString texturePath);
-    QOpenGLTexture* makeTexture(const gli::texture& texture);
-    QOpenGLTexture* makeSolidColor(QVector4D color);
+    struct DecodedTexture
+    {
+        QString key;
+        int maxSize = 0;
+        TextureData texture;
+    };
 
-    QString resolvePath(const MOBase::IPluginGame* game, QString path);
+    struct DecodeResults
+    {
+        std::mutex mutex;
+        std::condition_variable decoded;
+        std::vector<DecodedTexture> textures;
+        std::function<void()> onReady;
+    };
 
-    MOBase::IOrganizer* m_MOInfo;
+    struct LoadedTexture
+    {
+        QOpenGLTexture* texture = nullptr;
+
+        // Size the texture was loaded for, 0 once it's at full resolution
+        int maxSize = 0;
+        bool failed = false;
+    };
+
+    struct Upload
+    {
+        QString key;
+        int maxSize = 0;
+        qint64 size = 0;
+
+        // Whether shapes are already using the partially uploaded texture
+        bool visible = false;
+    };
+
+    inline static constexpr int MinTextureSize = 64;
+    inline static constexpr int MaxTextureSize = 8192;
+
+    inline static bool MipSelection = true;
+    inline static qint64 UploadBudget = 16LL * 1024 * 1024;
+
+    static QThreadPool* decodePool();
+    static QString cacheKey(const QString& key, int maxSize);
+
+    void loadTexture(const QString& key, QString texturePath, int maxSize);
+    void replaceTexture(const QString& key, QOpenGLTexture* texture, int maxSize);
+    static DecodedTexture decodeTexture(
+        const QString& texturePath,
+        const QString& realPath,
+        const QStringList& archives,
+        int maxSize);
+
+    bool updateUpload(const TextureUploader::Progress& progress);
+    QOpenGLTexture* makeSolidColor(QVector4D color);
+
+    std::shared_ptr<PathResolver> m_Resolver;
     QOpenGLTexture* m_ErrorTexture = nullptr;
     QOpenGLTexture* m_BlackTexture = nullptr;
     QOpenGLTexture* m_WhiteTexture = nullptr;
     QOpenGLTexture* m_FlatNormalTexture = nullptr;
 
-    std::map<std::wstring, QOpenGLTexture*> m_Textures;
+    std::map<QString, LoadedTexture> m_Textures;
+    std::set<QString> m_Pending;
+
+    // Lower resolution textures that shapes may still reference until they resolve
+    // their textures again, after which releaseSuperseded frees them
+    std::vector<QOpenGLTexture*> m_Superseded;
+    bool m_Replaced = false;
+    std::optional<QStringList> m_Archives;
+
+    TextureUploader m_Uploader;
+    std::map<QOpenGLTexture*, Upload> m_Uploads;
+
+    std::function<void()> m_OnReady;
+    std::shared_ptr<DecodeResults> m_Results;
+    std::shared_ptr<TraceSummary> m_TraceSummary;
 };
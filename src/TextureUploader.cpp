@@ -0,0 +1,282 @@
+#include "TextureUploader.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLVersionFunctionsFactory>
+
+#include <algorithm>
+#include <cstring>
+
+QOpenGLTexture* TextureUploader::add(TextureData data)
+{
+    if (data.empty()) {
+        return nullptr;
+    }
+
+    gli::gl GL(gli::gl::PROFILE_GL32);
+
+    Job job;
+    job.format = GL.translate(data.format(), data.swizzles());
+    job.target = GL.translate(data.target());
+    job.level = data.levels() - 1;
+
+    QOpenGLTexture* glTexture =
+        new QOpenGLTexture(static_cast<QOpenGLTexture::Target>(job.target));
+
+    glTexture->create();
+    glTexture->bind();
+    glTexture->setMipLevels(data.levels());
+    glTexture->setMipMaxLevel(data.levels() - 1);
+    glTexture->setMinMagFilters(QOpenGLTexture::LinearMipMapLinear,
+                                QOpenGLTexture::Linear);
+    glTexture->setSwizzleMask(
+        static_cast<QOpenGLTexture::SwizzleValue>(job.format.Swizzles[0]),
+        static_cast<QOpenGLTexture::SwizzleValue>(job.format.Swizzles[1]),
+        static_cast<QOpenGLTexture::SwizzleValue>(job.format.Swizzles[2]),
+        static_cast<QOpenGLTexture::SwizzleValue>(job.format.Swizzles[3]));
+
+    glTexture->setWrapMode(QOpenGLTexture::Repeat);
+
+    auto extent = data.extent();
+
+    glTexture->setSize(extent.x, extent.y, extent.z);
+    glTexture->setFormat(static_cast<QOpenGLTexture::TextureFormat>(job.format.Internal));
+    glTexture->allocateStorage(
+        static_cast<QOpenGLTexture::PixelFormat>(job.format.External),
+        static_cast<QOpenGLTexture::PixelType>(job.format.Type));
+
+    // Sampling is limited to the levels that have been uploaded
+    glTexture->setMipBaseLevel(job.level);
+    glTexture->release();
+
+    job.texture = glTexture;
+    job.data = std::move(data);
+    m_Jobs.push_back(std::move(job));
+
+    return glTexture;
+}
+
+std::vector<TextureUploader::Progress> TextureUploader::process(qint64 budget)
+{
+    std::vector<Progress> progress;
+    if (m_Jobs.empty()) {
+        return progress;
+    }
+
+    auto f = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_2_1>(
+        QOpenGLContext::currentContext());
+
+    // Level data is tightly packed
+    f->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    qint64 uploaded = 0;
+    while (!m_Jobs.empty() && (budget <= 0 || uploaded < budget)) {
+        auto job = coarsestJob();
+        uploaded += uploadStep(f, *job);
+
+        if (job->image < job->data.layers() * job->data.faces()) {
+            continue;
+        }
+
+        job->texture->setMipBaseLevel(job->level);
+
+        auto it = std::find_if(progress.begin(), progress.end(), [&](const Progress& p) {
+            return p.texture == job->texture;
+        });
+        if (it == progress.end()) {
+            it = progress.insert(progress.end(), { job->texture });
+        }
+
+        it->size = levelSize(*job, job->level);
+        it->finished = job->level == 0;
+
+        if (it->finished) {
+            m_Jobs.erase(job);
+        }
+        else {
+            job->level--;
+            job->image = 0;
+        }
+    }
+
+    f->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    return progress;
+}
+
+void TextureUploader::clear()
+{
+    m_Jobs.clear();
+
+    for (auto& buffer : m_Buffers) {
+        buffer.destroy();
+    }
+}
+
+int TextureUploader::levelSize(const Job& job, std::size_t level)
+{
+    auto extent = job.data.extent(level);
+    return std::max({ extent.x, extent.y, extent.z });
+}
+
+std::list<TextureUploader::Job>::iterator TextureUploader::coarsestJob()
+{
+    return std::min_element(m_Jobs.begin(), m_Jobs.end(), [](const Job& a, const Job& b) {
+        return levelSize(a, a.level) < levelSize(b, b.level);
+    });
+}
+
+qint64 TextureUploader::uploadStep(QOpenGLFunctions_2_1* f, Job& job)
+{
+    auto& data = job.data;
+    auto layer = job.image / data.faces();
+    auto face = job.image % data.faces();
+    auto image = data.data(layer, face, job.level);
+
+    GLenum target = gli::is_target_cube(data.target())
+                        ? static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face)
+                        : job.target;
+
+    // Other targets are rare and small, so they are uploaded whole from client memory
+    if (data.target() == gli::TARGET_2D || data.target() == gli::TARGET_CUBE) {
+        return uploadStrip(f, job, target, image);
+    }
+
+    uploadImage(f, job, target, image);
+    job.image++;
+
+    return static_cast<qint64>(data.size(job.level));
+}
+
+qint64 TextureUploader::uploadStrip(
+    QOpenGLFunctions_2_1* f,
+    Job& job,
+    GLenum target,
+    const void* data)
+{
+    auto extent = job.data.extent(job.level);
+    auto blockExtent = gli::block_extent(job.data.format());
+
+    auto blocksX = (extent.x + blockExtent.x - 1) / blockExtent.x;
+    auto rows = (extent.y + blockExtent.y - 1) / blockExtent.y;
+    int rowSize = blocksX * static_cast<int>(gli::block_size(job.data.format()));
+
+    auto stripRows = std::clamp(BufferSize / rowSize, 1, rows - job.row);
+    auto stripSize = stripRows * rowSize;
+    auto y = job.row * blockExtent.y;
+    auto height = std::min(stripRows * blockExtent.y, extent.y - y);
+
+    // The driver copies from the buffer on its own time; if it can't be mapped the strip
+    // is uploaded from client memory instead
+    auto source = static_cast<const char*>(data) + static_cast<std::size_t>(job.row) * rowSize;
+    const void* pixels = stage(source, stripSize) ? nullptr : source;
+
+    // Qt's upload functions lag badly so we just use the GL API
+    if (gli::is_compressed(job.data.format())) {
+        f->glCompressedTexSubImage2D(
+            target, job.level, 0, y, extent.x, height, job.format.Internal, stripSize,
+            pixels);
+    }
+    else {
+        f->glTexSubImage2D(
+            target, job.level, 0, y, extent.x, height, job.format.External,
+            job.format.Type, pixels);
+    }
+
+    QOpenGLBuffer::release(QOpenGLBuffer::PixelUnpackBuffer);
+
+    job.row += stripRows;
+    if (job.row >= rows) {
+        job.row = 0;
+        job.image++;
+    }
+
+    return stripSize;
+}
+
+void TextureUploader::uploadImage(
+    QOpenGLFunctions_2_1* f,
+    Job& job,
+    GLenum target,
+    const void* data)
+{
+    auto& texture = job.data;
+    auto format = job.format;
+    auto level = job.level;
+    auto layer = job.image / texture.faces();
+    auto extent = texture.extent(level);
+
+    switch (texture.target()) {
+    case gli::TARGET_1D:
+        if (gli::is_compressed(texture.format())) {
+            f->glCompressedTexSubImage1D(
+                target, level, 0, extent.x, format.Internal, texture.size(level), data);
+        }
+        else {
+            f->glTexSubImage1D(
+                target, level, 0, extent.x, format.External, format.Type, data);
+        }
+        break;
+    case gli::TARGET_1D_ARRAY:
+        if (gli::is_compressed(texture.format())) {
+            f->glCompressedTexSubImage2D(
+                target, level, 0, 0, extent.x, layer, format.Internal,
+                texture.size(level), data);
+        }
+        else {
+            f->glTexSubImage2D(
+                target, level, 0, 0, extent.x, layer, format.External, format.Type, data);
+        }
+        break;
+    case gli::TARGET_2D_ARRAY:
+    case gli::TARGET_3D:
+    case gli::TARGET_CUBE_ARRAY:
+        if (gli::is_compressed(texture.format())) {
+            f->glCompressedTexSubImage3D(
+                target, level, 0, 0, 0, extent.x, extent.y,
+                texture.target() == gli::TARGET_3D ? extent.z : layer, format.Internal,
+                texture.size(level), data);
+        }
+        else {
+            f->glTexSubImage3D(
+                target, level, 0, 0, 0, extent.x, extent.y,
+                texture.target() == gli::TARGET_3D ? extent.z : layer, format.External,
+                format.Type, data);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+bool TextureUploader::stage(const void* data, int size)
+{
+    auto& buffer = m_Buffers[m_NextBuffer];
+    m_NextBuffer = (m_NextBuffer + 1) % RingSize;
+
+    if (!buffer.isCreated()) {
+        if (!buffer.create()) {
+            return false;
+        }
+        buffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+    }
+
+    buffer.bind();
+
+    // Reallocating orphans the old storage, so mapping never waits for the GPU to
+    // finish reading the previous strip
+    buffer.allocate(size);
+
+    auto mapped = buffer.map(QOpenGLBuffer::WriteOnly);
+    if (!mapped) {
+        buffer.release();
+        return false;
+    }
+
+    std::memcpy(mapped, data, size);
+
+    if (!buffer.unmap()) {
+        buffer.release();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "TextureData.h"
+
+#include <gli/gli.hpp>
+
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions_2_1>
+#include <QOpenGLTexture>
+
+#include <array>
+#include <cstddef>
+#include <list>
+#include <vector>
+
+// Streams textures to the GPU over several frames. Levels are uploaded smallest first
+// across every queued texture, 2D and cube map images in strips copied through a ring
+// of pixel buffer objects, and each call stops once its byte budget is spent. A
+// texture samples only the levels uploaded so far, so it shows blurry right away and
+// sharpens as the rest arrives.
+class TextureUploader
+{
+public:
+    struct Progress
+    {
+        QOpenGLTexture* texture = nullptr;
+
+        // Largest dimension of the finest level uploaded so far
+        int size = 0;
+        bool finished = false;
+    };
+
+    TextureUploader() = default;
+    TextureUploader(const TextureUploader&) = delete;
+    TextureUploader(TextureUploader&&) = delete;
+    TextureUploader& operator=(const TextureUploader&) = delete;
+    TextureUploader& operator=(TextureUploader&&) = delete;
+
+    // Creates the texture with storage for every level and queues its data; requires
+    // a current context. Returns nullptr if there is nothing to upload.
+    QOpenGLTexture* add(TextureData data);
+
+    // Uploads until about budget bytes were sent, 0 for no limit, and reports the
+    // textures that completed a level. Always makes some progress.
+    std::vector<Progress> process(qint64 budget);
+
+    bool isEmpty() const { return m_Jobs.empty(); }
+    std::size_t count() const { return m_Jobs.size(); }
+
+    // Drops queued uploads without deleting their textures, and frees the buffers
+    void clear();
+
+private:
+    inline static constexpr int RingSize = 3;
+    inline static constexpr int BufferSize = 4 * 1024 * 1024;
+
+    struct Job
+    {
+        TextureData data;
+        QOpenGLTexture* texture = nullptr;
+        GLenum target = 0;
+        gli::gl::format format;
+
+        // Level being uploaded, counting down from the smallest, and the layer and
+        // face image and block row within it
+        std::size_t level = 0;
+        std::size_t image = 0;
+        int row = 0;
+    };
+
+    static int levelSize(const Job& job, std::size_t level);
+
+    std::list<Job>::iterator coarsestJob();
+
+    // Uploads the next part of the job's current level and returns the bytes sent
+    qint64 uploadStep(QOpenGLFunctions_2_1* f, Job& job);
+    qint64 uploadStrip(QOpenGLFunctions_2_1* f, Job& job, GLenum target, const void* data);
+    void uploadImage(QOpenGLFunctions_2_1* f, Job& job, GLenum target, const void* data);
+
+    // Copies the data into the next buffer of the ring and leaves it bound; returns
+    // false if the buffer couldn't be mapped
+    bool stage(const void* data, int size);
+
+    std::list<Job> m_Jobs;
+
+    std::array<QOpenGLBuffer, RingSize> m_Buffers{
+        QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer),
+        QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer),
+        QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer),
+    };
+    int m_NextBuffer = 0;
+};
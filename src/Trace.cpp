@@ -0,0 +1,250 @@
+#include "Trace.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QObject>
+#include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+
+#include <cstring>
+
+using Clock = std::chrono::steady_clock;
+
+static thread_local TraceSummary* CurrentSummary = nullptr;
+static thread_local int CurrentThreadId = -1;
+
+TraceSummary::Bind::Bind(TraceSummary* summary) : m_Previous{ CurrentSummary }
+{
+    CurrentSummary = summary;
+}
+
+TraceSummary::Bind::~Bind()
+{
+    CurrentSummary = m_Previous;
+}
+
+TraceSummary::TraceSummary(const QString& name) : m_Name{ name }, m_Created{ Clock::now() }
+{}
+
+void TraceSummary::add(const char* phase, std::chrono::nanoseconds duration)
+{
+    std::lock_guard lock{ m_Mutex };
+
+    for (auto& entry : m_Phases) {
+        if (std::strcmp(entry.name, phase) == 0) {
+            entry.count++;
+            entry.total += duration;
+            return;
+        }
+    }
+
+    m_Phases.push_back({ phase, 1, duration });
+}
+
+QString TraceSummary::toString() const
+{
+    auto milliseconds = [](std::chrono::nanoseconds duration) {
+        return QString::number(duration.count() / 1e6, 'f', 1);
+    };
+
+    QStringList phases;
+    {
+        std::lock_guard lock{ m_Mutex };
+        for (auto& phase : m_Phases) {
+            auto text = QString("%1 %2 ms").arg(phase.name).arg(milliseconds(phase.total));
+            if (phase.count > 1) {
+                text += QString(" (%1x)").arg(phase.count);
+            }
+            phases.append(text);
+        }
+    }
+
+    return QObject::tr("Loaded %1 in %2 ms: %3")
+        .arg(m_Name)
+        .arg(milliseconds(Clock::now() - m_Created))
+        .arg(phases.join(", "));
+}
+
+TraceSummary* TraceSummary::current()
+{
+    return CurrentSummary;
+}
+
+Trace& Trace::instance()
+{
+    static Trace trace;
+    return trace;
+}
+
+Trace::Trace() : m_Epoch{ Clock::now() } {}
+
+void Trace::setOutputFile(const QString& outputFile)
+{
+    std::lock_guard lock{ m_Mutex };
+    m_OutputFile = outputFile;
+    m_Enabled = !outputFile.isEmpty();
+
+    // Thread names are written again at the start of a new file
+    m_FlushedThreads = 0;
+
+    if (!m_Enabled) {
+        m_Events.clear();
+    }
+}
+
+void Trace::addEvent(const char* name, Clock::time_point start, Clock::time_point end)
+{
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    std::lock_guard lock{ m_Mutex };
+    if (m_Events.size() >= MaxEvents) {
+        if (!m_Dropping) {
+            m_Dropping = true;
+            qWarning(qUtf8Printable(
+                QObject::tr("Trace event limit reached, events are dropped until the next flush")));
+        }
+        return;
+    }
+
+    m_Events.push_back({
+        name,
+        threadId(),
+        duration_cast<microseconds>(start - m_Epoch).count(),
+        duration_cast<microseconds>(end - start).count(),
+    });
+}
+
+void Trace::flush()
+{
+    QString outputFile;
+    std::vector<Event> events;
+    std::vector<std::pair<int, QString>> threads;
+    {
+        std::lock_guard lock{ m_Mutex };
+        if (m_OutputFile.isEmpty()) {
+            return;
+        }
+
+        outputFile = m_OutputFile;
+        events.swap(m_Events);
+        m_Dropping = false;
+
+        for (auto i = m_FlushedThreads; i < m_ThreadNames.size(); i++) {
+            threads.emplace_back(static_cast<int>(i), m_ThreadNames[i]);
+        }
+        m_FlushedThreads = m_ThreadNames.size();
+    }
+
+    if (events.empty() && threads.empty()) {
+        return;
+    }
+
+    // Formatting and writing tens of thousands of events is kept off the GUI thread
+    QThreadPool::globalInstance()->start(
+        [this, outputFile, events = std::move(events), threads = std::move(threads)]() {
+            write(outputFile, events, threads);
+        });
+}
+
+void Trace::write(
+    const QString& outputFile,
+    const std::vector<Event>& events,
+    const std::vector<std::pair<int, QString>>& threads)
+{
+    std::lock_guard lock{ m_FileMutex };
+
+    bool append = m_WrittenFile == outputFile;
+    QDir().mkpath(QFileInfo(outputFile).absolutePath());
+
+    QFile file{ outputFile };
+    auto mode = QIODevice::WriteOnly | (append ? QIODevice::Append : QIODevice::Truncate);
+    if (!file.open(mode)) {
+        qWarning(qUtf8Printable(QObject::tr("Failed to write trace %1").arg(outputFile)));
+        return;
+    }
+
+    auto pid = QCoreApplication::applicationPid();
+
+    QByteArray data = append ? QByteArray() : QByteArray("[\n");
+    bool separate = append;
+    auto add = [&](const QJsonObject& object) {
+        if (separate) {
+            data += ",\n";
+        }
+        data += QJsonDocument(object).toJson(QJsonDocument::Compact);
+        separate = true;
+    };
+
+    for (auto& [thread, name] : threads) {
+        add(QJsonObject{
+            { "name", "thread_name" },
+            { "ph", "M" },
+            { "pid", pid },
+            { "tid", thread },
+            { "args", QJsonObject{ { "name", name } } },
+        });
+    }
+
+    for (auto& event : events) {
+        add(QJsonObject{
+            { "name", event.name },
+            { "ph", "X" },
+            { "pid", pid },
+            { "tid", event.thread },
+            { "ts", event.start },
+            { "dur", event.duration },
+        });
+    }
+
+    if (file.write(data) == data.size()) {
+        m_WrittenFile = outputFile;
+    }
+}
+
+int Trace::threadId()
+{
+    if (CurrentThreadId < 0) {
+        auto thread = QThread::currentThread();
+        auto name = thread->objectName();
+
+        if (qApp && thread == qApp->thread()) {
+            name = "GUI";
+        }
+        else if (name.isEmpty()) {
+            name = QString("Worker %1").arg(m_ThreadNames.size());
+        }
+
+        CurrentThreadId = static_cast<int>(m_ThreadNames.size());
+        m_ThreadNames.push_back(name);
+    }
+
+    return CurrentThreadId;
+}
+
+TraceScope::TraceScope(const char* name) : m_Name{ name }, m_Start{ Clock::now() } {}
+
+TraceScope::~TraceScope()
+{
+    auto summary = TraceSummary::current();
+    auto& trace = Trace::instance();
+
+    if (!summary && !trace.isEnabled()) {
+        return;
+    }
+
+    auto end = Clock::now();
+
+    if (summary) {
+        summary->add(m_Name, end - m_Start);
+    }
+
+    if (trace.isEnabled()) {
+        trace.addEvent(m_Name, m_Start, end);
+    }
+}
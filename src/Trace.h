@@ -0,0 +1,133 @@
+#pragma once
+
+#include <QString>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Accumulated time per phase for one preview, written to the log once it's loaded
+class TraceSummary
+{
+public:
+    // Makes scopes on the current thread report to the summary while it exists
+    class Bind
+    {
+    public:
+        explicit Bind(TraceSummary* summary);
+        ~Bind();
+        Bind(const Bind&) = delete;
+        Bind(Bind&&) = delete;
+        Bind& operator=(const Bind&) = delete;
+        Bind& operator=(Bind&&) = delete;
+
+    private:
+        TraceSummary* m_Previous;
+    };
+
+    explicit TraceSummary(const QString& name);
+
+    void add(const char* phase, std::chrono::nanoseconds duration);
+
+    const QString& name() const { return m_Name; }
+    QString toString() const;
+
+    static TraceSummary* current();
+
+private:
+    struct Phase
+    {
+        const char* name;
+        int count;
+        std::chrono::nanoseconds total;
+    };
+
+    QString m_Name;
+    std::chrono::steady_clock::time_point m_Created;
+
+    mutable std::mutex m_Mutex;
+    std::vector<Phase> m_Phases;
+};
+
+// Collects complete events from every thread in the Chrome trace event format,
+// which Perfetto and chrome://tracing can open. Events are appended to the file in the
+// format's JSON array form, which the viewers accept without the closing bracket.
+class Trace
+{
+public:
+    static Trace& instance();
+
+    Trace(const Trace&) = delete;
+    Trace(Trace&&) = delete;
+    Trace& operator=(const Trace&) = delete;
+    Trace& operator=(Trace&&) = delete;
+
+    // An empty path disables event recording
+    void setOutputFile(const QString& outputFile);
+    bool isEnabled() const { return m_Enabled.load(std::memory_order_relaxed); }
+
+    void addEvent(
+        const char* name,
+        std::chrono::steady_clock::time_point start,
+        std::chrono::steady_clock::time_point end);
+
+    // Appends the events recorded since the last flush to the trace file in the
+    // background and drops them
+    void flush();
+
+private:
+    struct Event
+    {
+        const char* name;
+        int thread;
+        std::int64_t start;
+        std::int64_t duration;
+    };
+
+    Trace();
+    ~Trace() = default;
+
+    int threadId();
+
+    // Starts the file over if it wasn't written in this session yet
+    void write(
+        const QString& outputFile,
+        const std::vector<Event>& events,
+        const std::vector<std::pair<int, QString>>& threads);
+
+    // Events waiting for the next flush
+    inline static constexpr std::size_t MaxEvents = 200000;
+
+    std::atomic<bool> m_Enabled = false;
+    std::chrono::steady_clock::time_point m_Epoch;
+
+    std::mutex m_Mutex;
+    QString m_OutputFile;
+    std::vector<Event> m_Events;
+    std::vector<QString> m_ThreadNames;
+    std::size_t m_FlushedThreads = 0;
+    bool m_Dropping = false;
+
+    // Held while writing, which happens on the thread pool
+    std::mutex m_FileMutex;
+    QString m_WrittenFile;
+};
+
+// Times the enclosing scope for the bound summary and, if enabled, the trace
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name);
+    ~TraceScope();
+    TraceScope(const TraceScope&) = delete;
+    TraceScope(TraceScope&&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+    TraceScope& operator=(TraceScope&&) = delete;
+
+private:
+    const char* m_Name;
+    std::chrono::steady_clock::time_point m_Start;
+};
@@ -0,0 +1,33 @@
+#include "VertexLayout.h"
+
+#include <cstdint>
+
+VertexLayout VertexLayout::forContext(QOpenGLContext* context)
+{
+    return create(
+        context->format().majorVersion() >= 3 ||
+        context->hasExtension("GL_ARB_half_float_vertex"));
+}
+
+VertexLayout VertexLayout::create(bool halfTexCoord)
+{
+    VertexLayout layout;
+    layout.halfTexCoord = halfTexCoord;
+
+    std::size_t offset = 0;
+    layout.position = offset;
+    offset += 3 * sizeof(float);
+    layout.texCoord = offset;
+    offset += layout.halfTexCoord ? 2 * sizeof(std::uint16_t) : 2 * sizeof(float);
+    layout.normal = offset;
+    offset += 4;
+    layout.tangent = offset;
+    offset += 4;
+    layout.bitangent = offset;
+    offset += 4;
+    layout.color = offset;
+    offset += 4;
+
+    layout.stride = static_cast<GLsizei>(offset);
+    return layout;
+}
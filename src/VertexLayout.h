@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QOpenGLContext>
+
+#include <cstddef>
+
+// Interleaved vertex format close to the packed BSTriShape layout: full precision
+// positions, half float UVs, signed normalized bytes for the tangent frame and
+// normalized bytes for colors
+struct VertexLayout
+{
+    static VertexLayout forContext(QOpenGLContext* context);
+    static VertexLayout create(bool halfTexCoord);
+
+    bool halfTexCoord = true;
+    GLsizei stride = 0;
+
+    std::size_t position = 0;
+    std::size_t texCoord = 0;
+    std::size_t normal = 0;
+    std::size_t tangent = 0;
+    std::size_t bitangent = 0;
+    std::size_t color = 0;
+};
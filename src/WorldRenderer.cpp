@@ -0,0 +1,328 @@
+#include "WorldRenderer.h"
+
+#include <QCoreApplication>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_2_1>
+#include <QOpenGLVersionFunctionsFactory>
+#include <QThread>
+
+#include <algorithm>
+#include <filesystem>
+
+WorldRenderer::WorldRenderer(
+    std::shared_ptr<LodGrid> grid,
+    std::shared_ptr<PathResolver> resolver)
+    : m_Grid{ std::move(grid) },
+      m_Resolver{ std::move(resolver) },
+      m_Loaded{ std::make_shared<LoadedFiles>() }
+{
+    // Parsing shares the machine with texture decoding
+    m_Loader.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+}
+
+WorldRenderer::~WorldRenderer()
+{
+    // Tiles still parsing finish into results nobody takes
+    m_Loader.clear();
+}
+
+void WorldRenderer::setSourceFile(const QString& fileName)
+{
+    m_StartTile = m_Grid->find(fileName);
+}
+
+void WorldRenderer::setTraceSummary(std::shared_ptr<TraceSummary> summary)
+{
+    m_TraceSummary = summary;
+    for (auto& [fileName, tile] : m_Tiles) {
+        tile->setTraceSummary(summary);
+    }
+}
+
+void WorldRenderer::setReadyCallback(std::function<void()> callback)
+{
+    m_OnReady = callback;
+    m_Loaded->onReady = callback;
+    for (auto& [fileName, tile] : m_Tiles) {
+        tile->setReadyCallback(callback);
+    }
+}
+
+void WorldRenderer::createResources()
+{
+    auto f = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_2_1>(
+        QOpenGLContext::currentContext());
+
+    // Frames are cleared before any tile has loaded
+    f->glEnable(GL_DEPTH_TEST);
+    f->glDepthFunc(GL_LEQUAL);
+    f->glClearColor(0.18, 0.18, 0.18, 1.0);
+
+    m_StreamPending = true;
+    m_HasResources = true;
+}
+
+void WorldRenderer::destroy()
+{
+    for (auto& [fileName, tile] : m_Tiles) {
+        tile->destroy();
+    }
+    m_Tiles.clear();
+
+    // Queued loads are dropped and running ones finish into the old results
+    m_Loader.clear();
+    m_Loaded = std::make_shared<LoadedFiles>();
+    m_Loaded->onReady = m_OnReady;
+
+    m_HasResources = false;
+}
+
+void WorldRenderer::render()
+{
+    if (!m_HasResources) {
+        createResources();
+    }
+
+    takeLoaded();
+    stream();
+
+    auto f = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_2_1>(
+        QOpenGLContext::currentContext());
+    f->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    m_Stats = {};
+    m_DrawCount = 0;
+    m_CulledCount = 0;
+    for (auto& [fileName, tile] : m_Tiles) {
+        tile->render();
+
+        auto stats = tile->stateStats();
+        m_Stats.applied += stats.applied;
+        m_Stats.avoided += stats.avoided;
+        m_DrawCount += tile->drawCount();
+        m_CulledCount += tile->culledCount();
+    }
+}
+
+void WorldRenderer::setInteracting(bool interacting)
+{
+    m_Interacting = interacting;
+    for (auto& [fileName, tile] : m_Tiles) {
+        tile->setInteracting(interacting);
+    }
+}
+
+void WorldRenderer::setViewport(int width, int height)
+{
+    m_ViewportWidth = width;
+    m_ViewportHeight = height;
+    for (auto& [fileName, tile] : m_Tiles) {
+        tile->setViewport(width, height);
+    }
+}
+
+void WorldRenderer::setCamera(Camera* camera)
+{
+    m_Camera = camera;
+    for (auto& [fileName, tile] : m_Tiles) {
+        tile->setCamera(camera);
+    }
+
+    // The camera looks at a point in GL space, where X is mirrored and Y is up
+    auto lookAt = camera->lookAt();
+    m_Focus = QVector2D(-lookAt.x(), lookAt.z());
+
+    // Zooming out shows more of the worldspace
+    m_Radius = qBound(m_Grid->tileSize() * 1.5f, camera->distance() * 2.0f, FarPlane);
+    m_StreamPending = true;
+}
+
+void WorldRenderer::frameCamera(Camera* camera) const
+{
+    camera->setDistanceRange(NearPlane, FarPlane * 0.5f);
+
+    auto tile = m_StartTile;
+    if (!tile) {
+        auto tiles = m_Grid->query(QVector2D(), FarPlane);
+        tile = tiles.empty() ? nullptr : tiles.front();
+    }
+
+    if (!tile) {
+        return;
+    }
+
+    auto halfSize = m_Grid->tileSize() * 0.5f;
+    auto center = m_Grid->origin(*tile) + QVector3D(halfSize, halfSize, 0.0f);
+
+    // Looking down onto the terrain from above the tile
+    camera->setLookAt({ -center.x(), center.z(), center.y() });
+    camera->setDistance(m_Grid->tileSize() * 1.5f);
+    camera->rotate(0.0f, 35.0f);
+}
+
+bool WorldRenderer::hasPendingTextures() const
+{
+    // Tiles still loading will request textures of their own
+    {
+        std::lock_guard lock{ m_Loaded->mutex };
+        if (!m_Loaded->loading.empty() || !m_Loaded->files.empty()) {
+            return true;
+        }
+    }
+
+    return std::any_of(m_Tiles.begin(), m_Tiles.end(), [](const auto& tile) {
+        return tile.second->hasPendingTextures();
+    });
+}
+
+bool WorldRenderer::isUploading() const
+{
+    return std::any_of(m_Tiles.begin(), m_Tiles.end(), [](const auto& tile) {
+        return tile.second->isUploading();
+    });
+}
+
+void WorldRenderer::stream()
+{
+    if (!m_StreamPending || !m_Camera) {
+        return;
+    }
+
+    m_StreamPending = false;
+
+    // Nearest first, so the limit drops the farthest tiles
+    auto keep = m_Grid->query(m_Focus, m_Radius * EvictFactor);
+    if (keep.size() > static_cast<std::size_t>(TileLimit)) {
+        keep.resize(TileLimit);
+    }
+
+    std::set<QString> keepFiles;
+    for (auto tile : keep) {
+        keepFiles.insert(tile->files.begin(), tile->files.end());
+    }
+
+    for (auto it = m_Tiles.begin(); it != m_Tiles.end();) {
+        if (keepFiles.count(it->first)) {
+            ++it;
+            continue;
+        }
+
+        it->second->destroy();
+        it = m_Tiles.erase(it);
+    }
+
+    // Requests queued for an earlier position are replaced in the new order
+    m_Loader.clear();
+
+    std::set<QString> loading;
+    {
+        std::lock_guard lock{ m_Loaded->mutex };
+        m_Loaded->wanted = keepFiles;
+        loading = m_Loaded->loading;
+    }
+
+    for (auto tile : keep) {
+        if (m_Grid->distance(*tile, m_Focus) > m_Radius) {
+            break;
+        }
+
+        for (auto& fileName : tile->files) {
+            if (m_Tiles.count(fileName) || m_Failed.count(fileName) || loading.count(fileName)) {
+                continue;
+            }
+
+            m_Loader.start([loaded = m_Loaded, summary = m_TraceSummary, fileName]() {
+                {
+                    std::lock_guard lock{ loaded->mutex };
+                    if (!loaded->wanted.count(fileName) ||
+                        !loaded->loading.insert(fileName).second) {
+                        return;
+                    }
+                }
+
+                TraceSummary::Bind bind{ summary.get() };
+
+                LoadedFile file;
+                file.fileName = fileName;
+                file.cachedMesh = MeshCache::instance().load(fileName);
+                if (!file.cachedMesh) {
+                    TraceScope scope{ "Parse NIF" };
+
+                    auto path = std::filesystem::path(fileName.toStdWString());
+                    file.nifFile = std::make_shared<nifly::NifFile>(path);
+
+                    if (!file.nifFile->IsValid()) {
+                        file.nifFile.reset();
+                    }
+                }
+
+                {
+                    std::lock_guard lock{ loaded->mutex };
+                    loaded->loading.erase(fileName);
+                    loaded->files.push_back(std::move(file));
+                }
+
+                QMetaObject::invokeMethod(
+                    qApp,
+                    [weak = std::weak_ptr(loaded)]() {
+                        if (auto loaded = weak.lock(); loaded && loaded->onReady) {
+                            loaded->onReady();
+                        }
+                    },
+                    Qt::QueuedConnection);
+            });
+        }
+    }
+}
+
+void WorldRenderer::takeLoaded()
+{
+    std::vector<LoadedFile> files;
+    {
+        std::lock_guard lock{ m_Loaded->mutex };
+        files.swap(m_Loaded->files);
+
+        // Tiles the camera moved away from while they loaded are dropped
+        files.erase(
+            std::remove_if(files.begin(), files.end(), [this](const LoadedFile& file) {
+                return !m_Loaded->wanted.count(file.fileName);
+            }),
+            files.end());
+    }
+
+    for (auto& file : files) {
+        if (!file.cachedMesh && !file.nifFile) {
+            qWarning(qUtf8Printable(QObject::tr("Failed to load file: %1").arg(file.fileName)));
+            m_Failed.insert(file.fileName);
+            continue;
+        }
+
+        if (!m_Tiles.count(file.fileName)) {
+            m_Tiles.emplace(file.fileName, createTile(file));
+        }
+    }
+}
+
+std::unique_ptr<NifRenderer> WorldRenderer::createTile(LoadedFile& loaded)
+{
+    auto tile = loaded.cachedMesh
+                    ? std::make_unique<NifRenderer>(std::move(loaded.cachedMesh), m_Resolver)
+                    : std::make_unique<NifRenderer>(std::move(loaded.nifFile), m_Resolver);
+
+    // Batches LOD shapes, and stores them in the mesh cache for the next visit
+    tile->setSourceFile(loaded.fileName);
+
+    if (auto gridTile = m_Grid->find(loaded.fileName)) {
+        tile->setOrigin(m_Grid->origin(*gridTile));
+    }
+
+    tile->setClearFramebuffer(false);
+    tile->setDepthRange(NearPlane, FarPlane);
+    tile->setViewport(m_ViewportWidth, m_ViewportHeight);
+    tile->setCamera(m_Camera);
+    tile->setInteracting(m_Interacting);
+    tile->setReadyCallback(m_OnReady);
+    tile->setTraceSummary(m_TraceSummary);
+
+    return tile;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "LodGrid.h"
+#include "MeshCache.h"
+#include "NifRenderer.h"
+#include "PathResolver.h"
+#include "SceneRenderer.h"
+
+#include <NifFile.hpp>
+
+#include <QThreadPool>
+#include <QVector2D>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+// Draws a whole worldspace LOD level by streaming its tiles in around the camera, each
+// drawn by its own NifRenderer into one frame. Tiles are parsed on a loader pool, and
+// the farthest are dropped once the view moves away or the tile limit is reached.
+class WorldRenderer : public SceneRenderer
+{
+public:
+    WorldRenderer(std::shared_ptr<LodGrid> grid, std::shared_ptr<PathResolver> resolver);
+
+    ~WorldRenderer() override;
+    WorldRenderer(const WorldRenderer&) = delete;
+    WorldRenderer(WorldRenderer&&) = delete;
+    WorldRenderer& operator=(const WorldRenderer&) = delete;
+    WorldRenderer& operator=(WorldRenderer&&) = delete;
+
+    // Tiles kept loaded at most, which bounds the memory used by the view
+    static void setTileLimit(int tiles) { TileLimit = qMax(1, tiles); }
+
+    // The view starts out over the tile the file belongs to
+    void setSourceFile(const QString& fileName) override;
+
+    // Loading work of tiles created afterwards is timed in the summary
+    void setTraceSummary(std::shared_ptr<TraceSummary> summary) override;
+
+    void setReadyCallback(std::function<void()> callback) override;
+
+    bool hasResources() const override { return m_HasResources; }
+    void createResources() override;
+
+    // Drops every tile; they are loaded again around the camera on the next render
+    void destroy() override;
+
+    // Takes loaded tiles, evicts tiles out of range and draws the rest
+    void render() override;
+    void setInteracting(bool interacting) override;
+
+    void setViewport(int width, int height) override;
+    void setCamera(Camera* camera) override;
+    void frameCamera(Camera* camera) const override;
+
+    bool hasPendingTextures() const override;
+    bool isUploading() const override;
+
+    GLState::Stats stateStats() const override { return m_Stats; }
+    int drawCount() const override { return m_DrawCount; }
+    int culledCount() const override { return m_CulledCount; }
+
+    std::size_t loadedTileCount() const { return m_Tiles.size(); }
+
+private:
+    inline static int TileLimit = 64;
+
+    // A LOD level can be seen from far away
+    inline static constexpr float NearPlane = 16.0f;
+    inline static constexpr float FarPlane = 1048576.0f;
+
+    // Tiles are kept until they are this much further out than the load radius, so
+    // moving back and forth doesn't reload them
+    inline static constexpr float EvictFactor = 1.5f;
+
+    struct LoadedFile
+    {
+        QString fileName;
+        std::shared_ptr<CachedMesh> cachedMesh;
+        std::shared_ptr<nifly::NifFile> nifFile;
+    };
+
+    // Shared with the loader jobs, which skip files that went out of range while
+    // they were queued
+    struct LoadedFiles
+    {
+        std::mutex mutex;
+        std::set<QString> wanted;
+        std::set<QString> loading;
+        std::vector<LoadedFile> files;
+        std::function<void()> onReady;
+    };
+
+    // Requests the tiles in range of the camera, nearest first, and evicts the others
+    void stream();
+    void takeLoaded();
+    std::unique_ptr<NifRenderer> createTile(LoadedFile& loaded);
+
+    std::shared_ptr<LodGrid> m_Grid;
+    std::shared_ptr<PathResolver> m_Resolver;
+    std::shared_ptr<TraceSummary> m_TraceSummary;
+    std::function<void()> m_OnReady;
+
+    const LodGrid::Tile* m_StartTile = nullptr;
+
+    QThreadPool m_Loader;
+    std::shared_ptr<LoadedFiles> m_Loaded;
+    std::map<QString, std::unique_ptr<NifRenderer>> m_Tiles;
+
+    // Files that couldn't be parsed aren't requested again
+    std::set<QString> m_Failed;
+
+    Camera* m_Camera = nullptr;
+    QVector2D m_Focus;
+    float m_Radius = 0.0f;
+    bool m_StreamPending = true;
+
+    int m_ViewportWidth = 0;
+    int m_ViewportHeight = 0;
+    bool m_Interacting = false;
+
+    bool m_HasResources = false;
+    GLState::Stats m_Stats;
+    int m_DrawCount = 0;
+    int m_CulledCount = 0;
+};
@@ -0,0 +1,250 @@
+#include "ArchiveIndex.h"
+#include "Camera.h"
+#include "MeshSimplifier.h"
+#include "NifRenderer.h"
+#include "PathResolver.h"
+#include "ShaderManager.h"
+#include "TextureManager.h"
+
+#include <NifFile.hpp>
+
+#include <QCommandLineParser>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QLoggingCategory>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QThread>
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+struct Job
+{
+    QDir inputDirectory;
+    QDir outputDirectory;
+    QStringList files;
+    QSize size;
+
+    // Directory resolvers are read only, so one is shared by every thread
+    std::shared_ptr<PathResolver> resolver;
+
+    std::atomic<qsizetype> next = 0;
+    std::atomic<int> rendered = 0;
+    std::atomic<int> failed = 0;
+};
+
+static QSurfaceFormat surfaceFormat()
+{
+    QSurfaceFormat format;
+    format.setVersion(2, 1);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    return format;
+}
+
+static bool renderFile(
+    Job& job,
+    QOpenGLFramebufferObject& fbo,
+    const QString& fileName,
+    const QString& outputPath)
+{
+    auto path = std::filesystem::path(fileName.toStdWString());
+    auto nifFile = std::make_shared<nifly::NifFile>(path);
+    if (!nifFile->IsValid()) {
+        return false;
+    }
+
+    NifRenderer renderer{ nifFile, job.resolver };
+    renderer.setSourceFile(fileName);
+    renderer.createResources();
+
+    Camera camera;
+    renderer.frameCamera(&camera);
+    renderer.setCamera(&camera);
+    renderer.setViewport(job.size.width(), job.size.height());
+
+    // Only textures of shapes in view are loaded, and there's no event loop on this
+    // thread to deliver texture callbacks
+    renderer.updateVisibility();
+    renderer.textureManager()->waitForPending();
+    renderer.render();
+
+    auto image = fbo.toImage();
+    renderer.destroy();
+
+    QDir().mkpath(QFileInfo(outputPath).absolutePath());
+    return image.save(outputPath, "PNG");
+}
+
+static void renderThread(Job& job, QOffscreenSurface* surface)
+{
+    QOpenGLContext context;
+    context.setFormat(surfaceFormat());
+
+    if (!context.create() || !context.makeCurrent(surface)) {
+        qWarning("Failed to create render context");
+        return;
+    }
+
+    QOpenGLFramebufferObjectFormat fboFormat;
+    fboFormat.setAttachment(QOpenGLFramebufferObject::Depth);
+
+    QOpenGLFramebufferObject fbo{ job.size, fboFormat };
+    fbo.bind();
+    context.functions()->glViewport(0, 0, job.size.width(), job.size.height());
+
+    for (auto i = job.next++; i < job.files.size(); i = job.next++) {
+        auto& fileName = job.files[i];
+
+        auto relativePath = job.inputDirectory.relativeFilePath(fileName);
+        auto relativeInfo = QFileInfo(relativePath);
+        auto outputPath = job.outputDirectory.filePath(
+            QDir(relativeInfo.path()).filePath(relativeInfo.completeBaseName() + ".png"));
+
+        if (renderFile(job, fbo, fileName, outputPath)) {
+            job.rendered++;
+        }
+        else {
+            job.failed++;
+            qWarning("Failed to render %s", qUtf8Printable(fileName));
+        }
+    }
+
+    fbo.release();
+    context.doneCurrent();
+}
+
+int main(int argc, char* argv[])
+{
+    QGuiApplication app{ argc, argv };
+    QCoreApplication::setApplicationName("nif_thumbnailer");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Renders every NIF in a directory tree to a PNG thumbnail.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "Directory searched for .nif, .bto and .btr files");
+    parser.addPositionalArgument("output", "Directory the thumbnails are written to");
+
+    QCommandLineOption dataOption{
+        "data",
+        "Game data directory used to resolve textures (defaults to the input)",
+        "directory",
+    };
+    QCommandLineOption sizeOption{ "size", "Thumbnail size in pixels", "pixels", "256" };
+
+    // On llvmpipe, set LP_NUM_THREADS low; the scaling comes from one context per thread
+    QCommandLineOption threadsOption{
+        "threads",
+        "Number of render threads (0 for automatic)",
+        "count",
+        "0",
+    };
+    QCommandLineOption shadersOption{
+        "shaders",
+        "Directory containing the GLSL shaders",
+        "directory",
+        QDir(QCoreApplication::applicationDirPath()).filePath("shaders"),
+    };
+
+    parser.addOptions({ dataOption, sizeOption, threadsOption, shadersOption });
+    parser.process(app);
+
+    auto arguments = parser.positionalArguments();
+    if (arguments.size() != 2) {
+        parser.showHelp(1);
+    }
+
+    // Per-mesh debug output would drown the summary
+    QLoggingCategory::setFilterRules("*.debug=false");
+
+    Job job;
+    job.inputDirectory = QDir(arguments[0]);
+    job.outputDirectory = QDir(arguments[1]);
+
+    int size = qMax(16, parser.value(sizeOption).toInt());
+    job.size = QSize(size, size);
+
+    auto dataDirectory = parser.isSet(dataOption) ? parser.value(dataOption) : arguments[0];
+    auto archives = DirectoryResolver::findArchives(dataDirectory);
+    job.resolver = std::make_shared<DirectoryResolver>(dataDirectory, archives);
+    ArchiveIndex::instance().warm(archives);
+
+    ShaderManager::setShaderDirectory(parser.value(shadersOption));
+
+    // Creates the decode pool on this thread, where its parent lives
+    TextureManager::setDecodeThreads(0);
+
+    // Each thumbnail is a single still frame, so textures are uploaded whole and
+    // reduced detail meshes would never be drawn
+    TextureManager::setUploadBudget(0);
+    MeshSimplifier::setTriangleBudget(0);
+
+    QDirIterator it{
+        job.inputDirectory.absolutePath(),
+        { "*.nif", "*.bto", "*.btr" },
+        QDir::Files,
+        QDirIterator::Subdirectories,
+    };
+    while (it.hasNext()) {
+        job.files.append(it.next());
+    }
+    job.files.sort();
+
+    int threadCount = parser.value(threadsOption).toInt();
+    if (threadCount <= 0) {
+        threadCount = QThread::idealThreadCount();
+    }
+    threadCount = qBound(1, threadCount, qMax(1, static_cast<int>(job.files.size())));
+
+    // Offscreen surfaces have to be created on the GUI thread
+    std::vector<std::unique_ptr<QOffscreenSurface>> surfaces;
+    std::vector<std::unique_ptr<QThread>> threads;
+    int running = threadCount;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < threadCount; i++) {
+        auto surface = std::make_unique<QOffscreenSurface>();
+        surface->setFormat(surfaceFormat());
+        surface->create();
+
+        auto thread = std::unique_ptr<QThread>(
+            QThread::create([&job, surface = surface.get()]() { renderThread(job, surface); }));
+        QObject::connect(thread.get(), &QThread::finished, &app, [&running]() {
+            if (--running == 0) {
+                QCoreApplication::quit();
+            }
+        });
+
+        thread->start();
+        surfaces.push_back(std::move(surface));
+        threads.push_back(std::move(thread));
+    }
+
+    app.exec();
+
+    for (auto& thread : threads) {
+        thread->wait();
+    }
+
+    double seconds = timer.elapsed() / 1000.0;
+    std::printf(
+        "Rendered %d of %lld files (%d failed) on %d threads in %.1f s, %.1f files/s\n",
+        job.rendered.load(),
+        static_cast<long long>(job.files.size()),
+        job.failed.load(),
+        threadCount,
+        seconds,
+        seconds > 0.0 ? job.rendered.load() / seconds : 0.0);
+
+    return job.failed > 0 ? 1 : 0;
+}